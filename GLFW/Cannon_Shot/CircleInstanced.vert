@@ -0,0 +1,23 @@
+#version 330 core
+
+// input data : unit circle mesh, shared by every instance
+layout (location = 0) in vec3 vertexPosition;
+// per instance : centre x, y and radius, then the color
+layout (location = 2) in vec3 instanceCircle;
+layout (location = 3) in vec3 instanceColor;
+
+// shared by every program, filled once per frame
+layout (std140) uniform Frame {
+    mat4 sceneVP;   // projection * view, the camera follows the pan
+    mat4 screenVP;  // projection * fixed view, for the background and text
+};
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    vec2 position = instanceCircle.xy + vertexPosition.xy * instanceCircle.z;
+    fragColor = instanceColor;
+    gl_Position = sceneVP * vec4(position, vertexPosition.z, 1);
+}
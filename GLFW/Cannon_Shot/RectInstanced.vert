@@ -0,0 +1,27 @@
+#version 330 core
+
+// input data : unit quad centred on the origin, shared by every instance
+layout (location = 0) in vec3 vertexPosition;
+// per instance : centre x, y, width, height, then angle in radians, then the color
+layout (location = 2) in vec4 instanceRect;
+layout (location = 3) in float instanceAngle;
+layout (location = 4) in vec3 instanceColor;
+
+// shared by every program, filled once per frame
+layout (std140) uniform Frame {
+    mat4 sceneVP;   // projection * view, the camera follows the pan
+    mat4 screenVP;  // projection * fixed view, for the background and text
+};
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    vec2 size = vertexPosition.xy * instanceRect.zw;
+    float c = cos(instanceAngle);
+    float s = sin(instanceAngle);
+    vec2 position = instanceRect.xy + vec2(c * size.x - s * size.y, s * size.x + c * size.y);
+    fragColor = instanceColor;
+    gl_Position = sceneVP * vec4(position, vertexPosition.z, 1);
+}
@@ -4,19 +4,28 @@
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
 
-uniform mat4 MVP;
+// shared by every program, filled once per frame
+layout (std140) uniform Frame {
+    mat4 sceneVP;   // projection * view, the camera follows the pan
+    mat4 screenVP;  // projection * fixed view, for the background and text
+};
+
+// x, y and angle in radians of the object
+uniform vec3 placement;
 
 // output data : used by fragment shader
 out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    float c = cos(placement.z);
+    float s = sin(placement.z);
+    vec2 p = vec2(c * vertexPosition.x - s * vertexPosition.y, s * vertexPosition.x + c * vertexPosition.y);
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
     fragColor = vertexColor;
 
-    // Output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * v;
+    // Output position of the vertex, in clip space
+    gl_Position = sceneVP * vec4(p + placement.xy, vertexPosition.z, 1);
 }
@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <SOIL/SOIL.h>
+
+#include "assetpack.h"
+
+using namespace std;
+
+/* Stored under the file name without its directory, which is the name
+ * the game asks for */
+static const char* assetName(const char *path){
+  const char *slash = strrchr(path, '/');
+  return slash == NULL ? path : slash + 1;
+}
+
+static bool isImage(const char *path){
+  const char *dot = strrchr(path, '.');
+  return dot != NULL && (strcmp(dot, ".png") == 0 || strcmp(dot, ".jpg") == 0 || strcmp(dot, ".bmp") == 0);
+}
+
+static bool readFile(const char *path, vector<char> &bytes){
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+    return false;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  bytes.resize(size > 0 ? size : 0);
+  bool ok = size >= 0 && (size == 0 || fread(&bytes[0], 1, size, file) == (size_t)size);
+  fclose(file);
+  return ok;
+}
+
+/* Asset baker. Decodes images to RGB with their whole mip chain and
+ * copies everything else as it is, into one pack the game maps. */
+int main(int argc, char **argv){
+  if(argc < 3){
+    fprintf(stderr, "usage: assetbake <out.pack> <files...>\n");
+    return 1;
+  }
+  AssetPackWriter pack;
+  if(!pack.begin(argv[1])){
+    fprintf(stderr, "%s\n", pack.getError());
+    return 1;
+  }
+  for(int k = 2; k < argc; k++){
+    const char *path = argv[k];
+    bool ok;
+    if(isImage(path)){
+      int width, height;
+      unsigned char *image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGB);
+      if(image == NULL){
+        fprintf(stderr, "%s: could not decode image\n", path);
+        return 1;
+      }
+      ok = pack.addTexture(assetName(path), image, width, height);
+      SOIL_free_image_data(image);
+    }
+    else{
+      vector<char> bytes;
+      if(!readFile(path, bytes)){
+        fprintf(stderr, "%s: could not read\n", path);
+        return 1;
+      }
+      ok = pack.addRaw(assetName(path), bytes.empty() ? NULL : &bytes[0], bytes.size());
+    }
+    if(!ok){
+      fprintf(stderr, "%s\n", pack.getError());
+      return 1;
+    }
+  }
+  if(!pack.finish()){
+    fprintf(stderr, "%s\n", pack.getError());
+    return 1;
+  }
+  printf("%s: %d assets\n", argv[1], argc - 2);
+  return 0;
+}
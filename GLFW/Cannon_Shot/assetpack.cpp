@@ -0,0 +1,283 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "assetpack.h"
+
+using namespace std;
+
+size_t textureLevelSize(int width, int height, int level){
+  int w = max(1, width >> level);
+  int h = max(1, height >> level);
+  return (size_t)w * h * 3;
+}
+
+int textureLevelCount(int width, int height){
+  int levels = 1;
+  while(width > 1 || height > 1){
+    width = max(1, width / 2);
+    height = max(1, height / 2);
+    levels++;
+  }
+  return levels;
+}
+
+void downsampleRGB(const unsigned char *above, int width, int height, unsigned char *below){
+  int nw = max(1, width / 2), nh = max(1, height / 2);
+  for(int y = 0; y < nh; y++)
+    for(int x = 0; x < nw; x++){
+      int x0 = min(2 * x, width - 1), x1 = min(2 * x + 1, width - 1);
+      int y0 = min(2 * y, height - 1), y1 = min(2 * y + 1, height - 1);
+      for(int c = 0; c < 3; c++){
+        int sum = above[((size_t)y0 * width + x0) * 3 + c] + above[((size_t)y0 * width + x1) * 3 + c]
+                + above[((size_t)y1 * width + x0) * 3 + c] + above[((size_t)y1 * width + x1) * 3 + c];
+        below[((size_t)y * nw + x) * 3 + c] = (sum + 2) / 4;
+      }
+    }
+}
+
+static bool entryBefore(const AssetEntry &a, const AssetEntry &b){
+  return strcmp(a.name, b.name) < 0;
+}
+
+AssetPack::AssetPack(){
+  this->mapping = NULL;
+  this->mappingSize = 0;
+  this->entries = NULL;
+  this->entryCount = 0;
+}
+
+AssetPack::~AssetPack(){
+  if(mapping != NULL)
+    munmap(mapping, mappingSize);
+}
+
+bool AssetPack::fail(const char *path, const char *message){
+  char buffer[512];
+  snprintf(buffer, sizeof(buffer), "%s: %s", path, message);
+  error = buffer;
+  return false;
+}
+
+/* Maps the whole pack and checks the header and that every entry lies
+ * inside the file, nothing is copied */
+bool AssetPack::open(const char *path){
+  int fd = ::open(path, O_RDONLY);
+  if(fd < 0)
+    return fail(path, "could not open asset pack");
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(AssetPackHeader)){
+    close(fd);
+    return fail(path, "file is too small to be an asset pack");
+  }
+  void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+    return fail(path, "could not map asset pack");
+
+  const char *bytes = (const char*)data;
+  uint64_t fileSize = info.st_size;
+  AssetPackHeader head;
+  memcpy(&head, bytes, sizeof(head));
+  const char *problem = NULL;
+  if(head.magic != ASSET_PACK_MAGIC)
+    problem = "not an asset pack";
+  else if(head.version != ASSET_PACK_VERSION)
+    problem = "asset pack has an unsupported version";
+  else if(head.indexOffset % 8 != 0 || head.indexOffset + (uint64_t)head.entryCount * sizeof(AssetEntry) > fileSize)
+    problem = "asset pack is truncated or corrupt";
+  else{
+    const AssetEntry *index = (const AssetEntry*)(bytes + head.indexOffset);
+    for(uint32_t k = 0; k < head.entryCount && problem == NULL; k++){
+      const AssetEntry &entry = index[k];
+      if(entry.offset > fileSize || entry.size > fileSize - entry.offset || memchr(entry.name, '\0', sizeof(entry.name)) == NULL)
+        problem = "asset pack is truncated or corrupt";
+      else if(entry.type == ASSET_TEXTURE_RGB){
+        size_t expected = 0;
+        for(uint32_t level = 0; level < entry.levels && level < 32; level++)
+          expected += textureLevelSize(entry.width, entry.height, level);
+        if(entry.levels == 0 || entry.levels > 32 || expected != entry.size)
+          problem = "asset pack has a malformed texture";
+      }
+    }
+  }
+  if(problem != NULL){
+    munmap(data, info.st_size);
+    return fail(path, problem);
+  }
+
+  if(mapping != NULL)
+    munmap(mapping, mappingSize);
+  mapping = data;
+  mappingSize = info.st_size;
+  entries = (const AssetEntry*)(bytes + head.indexOffset);
+  entryCount = head.entryCount;
+  return true;
+}
+
+bool AssetPack::isOpen(){
+  return mapping != NULL;
+}
+
+/* The index is sorted by name when it is baked */
+const AssetEntry* AssetPack::find(const char *name){
+  int low = 0, high = entryCount - 1;
+  while(low <= high){
+    int middle = (low + high) / 2;
+    int order = strcmp(name, entries[middle].name);
+    if(order == 0)
+      return &entries[middle];
+    if(order < 0)
+      high = middle - 1;
+    else
+      low = middle + 1;
+  }
+  return NULL;
+}
+
+const unsigned char* AssetPack::getData(const AssetEntry *entry){
+  return (const unsigned char*)mapping + entry->offset;
+}
+
+const unsigned char* AssetPack::getLevel(const AssetEntry *entry, int level, int &width, int &height){
+  const unsigned char *data = getData(entry);
+  for(int k = 0; k < level; k++)
+    data += textureLevelSize(entry->width, entry->height, k);
+  width = max(1, (int)entry->width >> level);
+  height = max(1, (int)entry->height >> level);
+  return data;
+}
+
+const char* AssetPack::getError(){
+  return error.c_str();
+}
+
+AssetPackWriter::AssetPackWriter(){
+  this->file = NULL;
+  this->position = 0;
+}
+
+AssetPackWriter::~AssetPackWriter(){
+  if(file != NULL)
+    fclose(file);
+}
+
+bool AssetPackWriter::begin(const char *path){
+  this->path = path;
+  file = fopen(path, "wb");
+  if(file == NULL){
+    error = this->path + ": could not write asset pack";
+    return false;
+  }
+  index.clear();
+  position = 0;
+  AssetPackHeader head;
+  memset(&head, 0, sizeof(head));
+  return write(&head, sizeof(head));
+}
+
+bool AssetPackWriter::write(const void *data, size_t size){
+  if(size > 0 && fwrite(data, 1, size, file) != size){
+    error = path + ": could not write asset pack";
+    return false;
+  }
+  position += size;
+  return true;
+}
+
+bool AssetPackWriter::align(){
+  static const char zeros[16] = {0};
+  return write(zeros, (16 - position % 16) % 16);
+}
+
+bool AssetPackWriter::addEntry(const char *name, AssetEntry &entry){
+  if(strlen(name) >= sizeof(entry.name)){
+    error = string(name) + ": asset name is too long";
+    return false;
+  }
+  strncpy(entry.name, name, sizeof(entry.name));
+  for(size_t k = 0; k < index.size(); k++)
+    if(strcmp(index[k].name, name) == 0){
+      error = string(name) + ": asset added twice";
+      return false;
+    }
+  index.push_back(entry);
+  return true;
+}
+
+bool AssetPackWriter::addRaw(const char *name, const void *data, size_t size){
+  AssetEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  if(!align())
+    return false;
+  entry.type = ASSET_RAW;
+  entry.levels = 1;
+  entry.offset = position;
+  entry.size = size;
+  return write(data, size) && addEntry(name, entry);
+}
+
+/* Stores the image and every mip level down to 1x1, the same chain
+ * glGenerateMipmap builds */
+bool AssetPackWriter::addTexture(const char *name, const unsigned char *rgb, int width, int height){
+  AssetEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  if(!align())
+    return false;
+  entry.type = ASSET_TEXTURE_RGB;
+  entry.offset = position;
+  entry.width = width;
+  entry.height = height;
+
+  vector<unsigned char> above(rgb, rgb + (size_t)width * height * 3);
+  vector<unsigned char> below;
+  int w = width, h = height;
+  if(!write(&above[0], above.size()))
+    return false;
+  entry.levels = 1;
+  entry.size = above.size();
+  while(w > 1 || h > 1){
+    int nw = max(1, w / 2), nh = max(1, h / 2);
+    below.resize((size_t)nw * nh * 3);
+    downsampleRGB(&above[0], w, h, &below[0]);
+    if(!write(&below[0], below.size()))
+      return false;
+    entry.levels++;
+    entry.size += below.size();
+    above.swap(below);
+    w = nw;
+    h = nh;
+  }
+  return addEntry(name, entry);
+}
+
+bool AssetPackWriter::finish(){
+  static const char zeros[8] = {0};
+  if(!write(zeros, (8 - position % 8) % 8))
+    return false;
+  sort(index.begin(), index.end(), entryBefore);
+  AssetPackHeader head;
+  memset(&head, 0, sizeof(head));
+  head.magic = ASSET_PACK_MAGIC;
+  head.version = ASSET_PACK_VERSION;
+  head.entryCount = index.size();
+  head.indexOffset = position;
+  if(!index.empty() && !write(&index[0], index.size() * sizeof(AssetEntry)))
+    return false;
+  bool ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&head, sizeof(head), 1, file) == 1;
+  ok = (fclose(file) == 0) && ok;
+  file = NULL;
+  if(!ok){
+    error = path + ": could not write asset pack";
+    return false;
+  }
+  return true;
+}
+
+const char* AssetPackWriter::getError(){
+  return error.c_str();
+}
@@ -0,0 +1,92 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+#define ASSET_PACK_MAGIC 0x50415343  // "CSAP" read as a little endian word
+#define ASSET_PACK_VERSION 1
+
+enum AssetType {
+  ASSET_RAW,          // file bytes as they were, shaders and fonts
+  ASSET_TEXTURE_RGB   // decoded 8 bit RGB, every mip level one after another
+};
+
+/* On disk layout: the header, the data of every asset 16 byte aligned,
+ * then the index of AssetEntry records sorted by name. */
+struct AssetPackHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t reserved;
+  uint64_t indexOffset;
+};
+typedef struct AssetPackHeader AssetPackHeader;
+
+struct AssetEntry {
+  char name[56];
+  uint32_t type;
+  uint32_t levels;   // mip levels of a texture, 1 for anything else
+  uint64_t offset;   // bytes from the start of the pack
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+};
+typedef struct AssetEntry AssetEntry;
+
+/* A baked pack mapped read only. Everything handed out points into
+ * the mapping, which lives as long as the AssetPack does. */
+class AssetPack{
+public:
+  AssetPack();
+  ~AssetPack();
+  bool open(const char *path);
+  bool isOpen();
+  const AssetEntry* find(const char *name);
+  const unsigned char* getData(const AssetEntry *entry);
+  const unsigned char* getLevel(const AssetEntry *entry, int level, int &width, int &height);
+  const char* getError();
+private:
+  bool fail(const char *path, const char *message);
+  void *mapping;
+  size_t mappingSize;
+  const AssetEntry *entries;
+  int entryCount;
+  std::string error;
+};
+
+/* Builds a pack for the bake tool */
+class AssetPackWriter{
+public:
+  AssetPackWriter();
+  ~AssetPackWriter();
+  bool begin(const char *path);
+  bool addRaw(const char *name, const void *data, size_t size);
+  bool addTexture(const char *name, const unsigned char *rgb, int width, int height);
+  bool finish();
+  const char* getError();
+private:
+  bool write(const void *data, size_t size);
+  bool align();
+  bool addEntry(const char *name, AssetEntry &entry);
+  FILE *file;
+  uint64_t position;
+  std::vector<AssetEntry> index;
+  std::string path;
+  std::string error;
+};
+
+/* Size in bytes of mip level `level` of a width x height RGB texture */
+size_t textureLevelSize(int width, int height, int level);
+
+/* Mip levels down to 1x1, the image itself included */
+int textureLevelCount(int width, int height);
+
+/* Next mip level of an RGB image, each texel a 2x2 box filter of the
+ * ones above it. below holds textureLevelSize(width, height, 1) bytes. */
+void downsampleRGB(const unsigned char *above, int width, int height, unsigned char *below);
+
+#endif
@@ -0,0 +1,129 @@
+#include <algorithm>
+
+#include "physics.h"
+#include "blocktree.h"
+
+using namespace std;
+
+static const int LEAF_SIZE = 4;
+static const int MAX_DEPTH = 64;
+
+struct CenterLess {
+  const float *centers;
+  bool operator()(int a, int b) const {
+    return centers[a] < centers[b];
+  }
+};
+
+BlockTree::BlockTree(){
+}
+
+/* indices[k] is what query() reports for blocks[k], the World passes
+ * positions in its obstacleList */
+void BlockTree::build(std::vector<Block*> &blocks, std::vector<int> &indices){
+  this->blocks = blocks;
+  this->indices = indices;
+  int n = blocks.size();
+  nodes.clear();
+  perm.resize(n);
+  centers.resize(2 * n);
+  for(int k = 0; k < n; k++){
+    perm[k] = k;
+    centers[k] = blocks[k]->getPositionX();
+    centers[n + k] = blocks[k]->getPositionY();
+  }
+  if(n > 0)
+    buildNode(0, n);
+}
+
+int BlockTree::buildNode(int first, int count){
+  int id = nodes.size();
+  nodes.push_back(TreeNode());
+  nodes[id].first = first;
+  nodes[id].count = count;
+  nodes[id].left = -1;
+  nodes[id].right = -1;
+  fitLeaf(nodes[id]);
+  if(count <= LEAF_SIZE)
+    return id;
+
+  // Split at the median along the longer side of the box
+  int n = blocks.size();
+  float w = nodes[id].maxX - nodes[id].minX;
+  float h = nodes[id].maxY - nodes[id].minY;
+  CenterLess less;
+  less.centers = (w >= h) ? &centers[0] : &centers[n];
+  int half = count / 2;
+  nth_element(perm.begin() + first, perm.begin() + first + half, perm.begin() + first + count, less);
+
+  int left = buildNode(first, half);
+  int right = buildNode(first + half, count - half);
+  nodes[id].left = left;
+  nodes[id].right = right;
+  nodes[id].count = 0;
+  return id;
+}
+
+void BlockTree::fitLeaf(TreeNode &node){
+  Block *b = blocks[perm[node.first]];
+  node.minX = b->getMinX();
+  node.maxX = b->getMaxX();
+  node.minY = b->getMinY();
+  node.maxY = b->getMaxY();
+  for(int k = node.first + 1; k < node.first + node.count; k++){
+    b = blocks[perm[k]];
+    node.minX = min(node.minX, b->getMinX());
+    node.maxX = max(node.maxX, b->getMaxX());
+    node.minY = min(node.minY, b->getMinY());
+    node.maxY = max(node.maxY, b->getMaxY());
+  }
+}
+
+/* Children always come after their parent, so walking backwards
+ * updates every child before the node that encloses it */
+void BlockTree::refit(){
+  for(int id = (int)nodes.size() - 1; id >= 0; id--){
+    TreeNode &node = nodes[id];
+    if(node.count > 0){
+      fitLeaf(node);
+    }
+    else{
+      TreeNode &l = nodes[node.left];
+      TreeNode &r = nodes[node.right];
+      node.minX = min(l.minX, r.minX);
+      node.maxX = max(l.maxX, r.maxX);
+      node.minY = min(l.minY, r.minY);
+      node.maxY = max(l.maxY, r.maxY);
+    }
+  }
+}
+
+/* Appends the index of every block whose box overlaps the query box */
+void BlockTree::query(float minX, float minY, float maxX, float maxY, std::vector<int> &out){
+  if(nodes.empty())
+    return;
+  int stack[MAX_DEPTH];
+  int top = 0;
+  stack[top++] = 0;
+  while(top > 0){
+    TreeNode &node = nodes[stack[--top]];
+    if(node.maxX < minX || node.minX > maxX || node.maxY < minY || node.minY > maxY)
+      continue;
+    if(node.count > 0){
+      for(int k = node.first; k < node.first + node.count; k++){
+        Block *b = blocks[perm[k]];
+        if(b->getMaxX() < minX || b->getMinX() > maxX || b->getMaxY() < minY || b->getMinY() > maxY)
+          continue;
+        out.push_back(indices[perm[k]]);
+      }
+    }
+    else{
+      stack[top++] = node.left;
+      stack[top++] = node.right;
+    }
+  }
+}
+
+int BlockTree::size(){
+  return blocks.size();
+}
@@ -0,0 +1,38 @@
+#ifndef BLOCKTREE_H
+#define BLOCKTREE_H
+
+#include <vector>
+
+class Block;
+
+/* Bounding volume hierarchy over a set of Blocks. Built once with
+ * median splits, nodes are stored parent before child so refit()
+ * can redo the boxes of moving blocks in one backwards sweep. */
+class BlockTree{
+public:
+  BlockTree();
+  void build(std::vector<Block*> &blocks, std::vector<int> &indices);
+  void refit();
+  void query(float minX, float minY, float maxX, float maxY, std::vector<int> &out);
+  int size();
+private:
+  struct TreeNode {
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    int left;
+    int right;
+    int first;
+    int count;
+  };
+  int buildNode(int first, int count);
+  void fitLeaf(TreeNode &node);
+  std::vector<TreeNode> nodes;
+  std::vector<Block*> blocks;
+  std::vector<int> indices;
+  std::vector<int> perm;
+  std::vector<float> centers;
+};
+
+#endif
@@ -0,0 +1,237 @@
+#if defined(__x86_64__) || defined(__i386__)
+#define BODIES_X86
+#include <immintrin.h>
+#endif
+
+#include "physics.h"
+#include "bodies.h"
+
+int BodyStore::add(float mass, float x, float y, float ux, float uy, float radius){
+  this->x.push_back(x);
+  this->y.push_back(y);
+  this->prevX.push_back(x);
+  this->prevY.push_back(y);
+  this->ux.push_back(ux);
+  this->uy.push_back(uy);
+  this->ax.push_back(0.0f);
+  this->ay.push_back(0.0f);
+  this->time.push_back(0.0f);
+  this->mass.push_back(mass);
+  this->radius.push_back(radius);
+  this->support.push_back(0.0f);
+  this->active.push_back(1.0f);
+  this->awake.push_back(1.0f);
+  this->restTicks.push_back(0);
+  this->present.push_back(1.0f);
+  return (int)this->x.size() - 1;
+}
+
+int BodyStore::size(){
+  return (int)x.size();
+}
+
+void BodyStore::reserve(int capacity){
+  x.reserve(capacity);
+  y.reserve(capacity);
+  prevX.reserve(capacity);
+  prevY.reserve(capacity);
+  ux.reserve(capacity);
+  uy.reserve(capacity);
+  ax.reserve(capacity);
+  ay.reserve(capacity);
+  time.reserve(capacity);
+  mass.reserve(capacity);
+  radius.reserve(capacity);
+  support.reserve(capacity);
+  active.reserve(capacity);
+  awake.reserve(capacity);
+  restTicks.reserve(capacity);
+  present.reserve(capacity);
+}
+
+/* Reference version of the kernel, also used for the tails the
+ * SIMD versions leave over. Every operation here has to be done in
+ * the same order as in the vector code or the results drift apart. */
+static void integrateScalar(BodyStore &bodies, int from, int to, float dt, float ground){
+  for(int i = from; i < to; i++){
+    if(bodies.active[i] <= 0.0f || bodies.awake[i] <= 0.0f)
+      continue;
+    float m = bodies.mass[i];
+    float r = bodies.radius[i];
+    float x = bodies.x[i];
+    float y = bodies.y[i];
+    float ux = bodies.ux[i];
+    float uy = bodies.uy[i];
+    float mg = m * Item::GRAVITY;
+
+    float fy = (0.0f - mg) + bodies.support[i] * mg;
+    float fx = 0.0f;
+    bool onGround = (y - ground <= r);
+    if(onGround){
+      float direction = (ux > 0.0f) ? -1.0f : 1.0f;
+      fx = direction * m * Item::GRAVITY * Item::FRICTION_COF;
+      if(uy < -20.5f){
+        uy = -1.0f * uy * Item::BOUNCE_COF;
+        y = y + (r + 0.01f);
+      }
+      else{
+        uy = 0.0f;
+        y = ground + r;
+      }
+    }
+    float ax = fx / m;
+    float ay = fy / m;
+
+    bodies.time[i] += dt;
+    bodies.prevX[i] = x;
+    bodies.prevY[i] = y;
+    bodies.x[i] = (x + ux * dt) + 0.5f * ax * dt * dt;
+    bodies.y[i] = (y + uy * dt) + 0.5f * ay * dt * dt;
+    bodies.ux[i] = ux + ax * dt;
+    bodies.uy[i] = uy + ay * dt;
+    bodies.ax[i] = ax;
+    bodies.ay[i] = ay;
+  }
+}
+
+#ifdef BODIES_X86
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b){
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static int integrateSSE(BodyStore &bodies, int n, float dt, float ground){
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 minusOne = _mm_set1_ps(-1.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 gravity = _mm_set1_ps(Item::GRAVITY);
+  const __m128 friction = _mm_set1_ps(Item::FRICTION_COF);
+  const __m128 bounce = _mm_set1_ps(Item::BOUNCE_COF);
+  const __m128 bounceSpeed = _mm_set1_ps(-20.5f);
+  const __m128 lift = _mm_set1_ps(0.01f);
+  const __m128 step = _mm_set1_ps(dt);
+  const __m128 floor = _mm_set1_ps(ground);
+  int i = 0;
+  for(; i + 4 <= n; i += 4){
+    __m128 active = _mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(&bodies.active[i]), zero), _mm_cmpgt_ps(_mm_loadu_ps(&bodies.awake[i]), zero));
+    if(_mm_movemask_ps(active) == 0)
+      continue;
+    __m128 m = _mm_loadu_ps(&bodies.mass[i]);
+    __m128 r = _mm_loadu_ps(&bodies.radius[i]);
+    __m128 x = _mm_loadu_ps(&bodies.x[i]);
+    __m128 y = _mm_loadu_ps(&bodies.y[i]);
+    __m128 ux = _mm_loadu_ps(&bodies.ux[i]);
+    __m128 uy = _mm_loadu_ps(&bodies.uy[i]);
+    __m128 mg = _mm_mul_ps(m, gravity);
+
+    __m128 fy = _mm_add_ps(_mm_sub_ps(zero, mg), _mm_mul_ps(_mm_loadu_ps(&bodies.support[i]), mg));
+    __m128 onGround = _mm_cmple_ps(_mm_sub_ps(y, floor), r);
+    __m128 direction = select4(_mm_cmpgt_ps(ux, zero), minusOne, one);
+    __m128 fx = _mm_and_ps(onGround, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(direction, m), gravity), friction));
+    __m128 bounced = _mm_and_ps(onGround, _mm_cmplt_ps(uy, bounceSpeed));
+    __m128 rested = _mm_andnot_ps(bounced, onGround);
+    uy = select4(bounced, _mm_mul_ps(_mm_mul_ps(minusOne, uy), bounce), select4(rested, zero, uy));
+    y = select4(bounced, _mm_add_ps(y, _mm_add_ps(r, lift)), select4(rested, _mm_add_ps(floor, r), y));
+    __m128 ax = _mm_div_ps(fx, m);
+    __m128 ay = _mm_div_ps(fy, m);
+
+    __m128 nx = _mm_add_ps(_mm_add_ps(x, _mm_mul_ps(ux, step)), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(half, ax), step), step));
+    __m128 ny = _mm_add_ps(_mm_add_ps(y, _mm_mul_ps(uy, step)), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(half, ay), step), step));
+    __m128 nux = _mm_add_ps(ux, _mm_mul_ps(ax, step));
+    __m128 nuy = _mm_add_ps(uy, _mm_mul_ps(ay, step));
+    __m128 time = _mm_loadu_ps(&bodies.time[i]);
+
+    _mm_storeu_ps(&bodies.time[i], select4(active, _mm_add_ps(time, step), time));
+    _mm_storeu_ps(&bodies.prevX[i], select4(active, x, _mm_loadu_ps(&bodies.prevX[i])));
+    _mm_storeu_ps(&bodies.prevY[i], select4(active, y, _mm_loadu_ps(&bodies.prevY[i])));
+    _mm_storeu_ps(&bodies.x[i], select4(active, nx, x));
+    _mm_storeu_ps(&bodies.y[i], select4(active, ny, _mm_loadu_ps(&bodies.y[i])));
+    _mm_storeu_ps(&bodies.ux[i], select4(active, nux, ux));
+    _mm_storeu_ps(&bodies.uy[i], select4(active, nuy, _mm_loadu_ps(&bodies.uy[i])));
+    _mm_storeu_ps(&bodies.ax[i], select4(active, ax, _mm_loadu_ps(&bodies.ax[i])));
+    _mm_storeu_ps(&bodies.ay[i], select4(active, ay, _mm_loadu_ps(&bodies.ay[i])));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int integrateAVX2(BodyStore &bodies, int n, float dt, float ground){
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 minusOne = _mm256_set1_ps(-1.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 gravity = _mm256_set1_ps(Item::GRAVITY);
+  const __m256 friction = _mm256_set1_ps(Item::FRICTION_COF);
+  const __m256 bounce = _mm256_set1_ps(Item::BOUNCE_COF);
+  const __m256 bounceSpeed = _mm256_set1_ps(-20.5f);
+  const __m256 lift = _mm256_set1_ps(0.01f);
+  const __m256 step = _mm256_set1_ps(dt);
+  const __m256 floor = _mm256_set1_ps(ground);
+  int i = 0;
+  for(; i + 8 <= n; i += 8){
+    __m256 active = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&bodies.active[i]), zero, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_loadu_ps(&bodies.awake[i]), zero, _CMP_GT_OQ));
+    if(_mm256_movemask_ps(active) == 0)
+      continue;
+    __m256 m = _mm256_loadu_ps(&bodies.mass[i]);
+    __m256 r = _mm256_loadu_ps(&bodies.radius[i]);
+    __m256 x = _mm256_loadu_ps(&bodies.x[i]);
+    __m256 y0 = _mm256_loadu_ps(&bodies.y[i]);
+    __m256 ux = _mm256_loadu_ps(&bodies.ux[i]);
+    __m256 uy0 = _mm256_loadu_ps(&bodies.uy[i]);
+    __m256 mg = _mm256_mul_ps(m, gravity);
+
+    __m256 fy = _mm256_add_ps(_mm256_sub_ps(zero, mg), _mm256_mul_ps(_mm256_loadu_ps(&bodies.support[i]), mg));
+    __m256 onGround = _mm256_cmp_ps(_mm256_sub_ps(y0, floor), r, _CMP_LE_OQ);
+    __m256 direction = _mm256_blendv_ps(one, minusOne, _mm256_cmp_ps(ux, zero, _CMP_GT_OQ));
+    __m256 fx = _mm256_and_ps(onGround, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(direction, m), gravity), friction));
+    __m256 bounced = _mm256_and_ps(onGround, _mm256_cmp_ps(uy0, bounceSpeed, _CMP_LT_OQ));
+    __m256 rested = _mm256_andnot_ps(bounced, onGround);
+    __m256 uy = _mm256_blendv_ps(_mm256_blendv_ps(uy0, zero, rested), _mm256_mul_ps(_mm256_mul_ps(minusOne, uy0), bounce), bounced);
+    __m256 y = _mm256_blendv_ps(_mm256_blendv_ps(y0, _mm256_add_ps(floor, r), rested), _mm256_add_ps(y0, _mm256_add_ps(r, lift)), bounced);
+    __m256 ax = _mm256_div_ps(fx, m);
+    __m256 ay = _mm256_div_ps(fy, m);
+
+    __m256 nx = _mm256_add_ps(_mm256_add_ps(x, _mm256_mul_ps(ux, step)), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(half, ax), step), step));
+    __m256 ny = _mm256_add_ps(_mm256_add_ps(y, _mm256_mul_ps(uy, step)), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(half, ay), step), step));
+    __m256 nux = _mm256_add_ps(ux, _mm256_mul_ps(ax, step));
+    __m256 nuy = _mm256_add_ps(uy, _mm256_mul_ps(ay, step));
+    __m256 time = _mm256_loadu_ps(&bodies.time[i]);
+
+    _mm256_storeu_ps(&bodies.time[i], _mm256_blendv_ps(time, _mm256_add_ps(time, step), active));
+    _mm256_storeu_ps(&bodies.prevX[i], _mm256_blendv_ps(_mm256_loadu_ps(&bodies.prevX[i]), x, active));
+    _mm256_storeu_ps(&bodies.prevY[i], _mm256_blendv_ps(_mm256_loadu_ps(&bodies.prevY[i]), y, active));
+    _mm256_storeu_ps(&bodies.x[i], _mm256_blendv_ps(x, nx, active));
+    _mm256_storeu_ps(&bodies.y[i], _mm256_blendv_ps(y0, ny, active));
+    _mm256_storeu_ps(&bodies.ux[i], _mm256_blendv_ps(ux, nux, active));
+    _mm256_storeu_ps(&bodies.uy[i], _mm256_blendv_ps(uy0, nuy, active));
+    _mm256_storeu_ps(&bodies.ax[i], _mm256_blendv_ps(_mm256_loadu_ps(&bodies.ax[i]), ax, active));
+    _mm256_storeu_ps(&bodies.ay[i], _mm256_blendv_ps(_mm256_loadu_ps(&bodies.ay[i]), ay, active));
+  }
+  return i;
+}
+
+#endif
+
+Integrator bestIntegrator(){
+#ifdef BODIES_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    return INTEGRATE_AVX2;
+  if(__builtin_cpu_supports("sse2"))
+    return INTEGRATE_SSE;
+#endif
+  return INTEGRATE_SCALAR;
+}
+
+void integrateBodies(BodyStore &bodies, float timeInstance, float ground, Integrator kind){
+  int n = bodies.size();
+  int done = 0;
+#ifdef BODIES_X86
+  if(kind == INTEGRATE_AVX2)
+    done = integrateAVX2(bodies, n, timeInstance, ground);
+  else if(kind == INTEGRATE_SSE)
+    done = integrateSSE(bodies, n, timeInstance, ground);
+#endif
+  integrateScalar(bodies, done, n, timeInstance, ground);
+}
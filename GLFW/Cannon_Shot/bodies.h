@@ -0,0 +1,47 @@
+#ifndef BODIES_H
+#define BODIES_H
+
+#include <vector>
+
+/* Structure of arrays holding the state of every movable body.
+ * An Item is just an index into one of these, so the integrator
+ * walks plain float arrays instead of chasing Item pointers. */
+struct BodyStore {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> prevX;
+  std::vector<float> prevY;
+  std::vector<float> ux;
+  std::vector<float> uy;
+  std::vector<float> ax;
+  std::vector<float> ay;
+  std::vector<float> time;
+  std::vector<float> mass;
+  std::vector<float> radius;
+  std::vector<float> support; // 1 if something holds the body up against gravity, else 0
+  std::vector<float> active;  // 1 if the body is integrated, 0 if it is frozen in place
+  std::vector<float> awake;   // 0 while the body is asleep, it is then skipped like an inactive one
+  std::vector<int> restTicks; // steps in a row the body has barely moved
+  std::vector<float> present; // 0 while the body is parked outside the simulation altogether
+
+  int add(float mass, float x, float y, float ux, float uy, float radius);
+  int size();
+  void reserve(int capacity);
+};
+typedef struct BodyStore BodyStore;
+
+enum Integrator {
+  INTEGRATE_SCALAR,
+  INTEGRATE_SSE,
+  INTEGRATE_AVX2
+};
+
+/* Widest integrator the running CPU supports */
+Integrator bestIntegrator();
+
+/* One pass over every active, awake body: gravity, ground friction,
+ * ground bounce and position update. All variants give bit
+ * identical results, the SIMD ones just do 4 or 8 bodies a time. */
+void integrateBodies(BodyStore &bodies, float timeInstance, float ground, Integrator kind);
+
+#endif
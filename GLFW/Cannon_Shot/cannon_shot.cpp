@@ -1,7 +1,20 @@
 #include <iostream>
 #include <cmath>
+#include <ctime>
+#include <algorithm>
 #include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,9 +24,19 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <FTGL/ftgl.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
 #include <SOIL/SOIL.h>
 
+#include "physics.h"
+#include "level.h"
+#include "assetpack.h"
+#include "offscreen.h"
+#include "profiler.h"
+#include "triplebuffer.h"
+#include "spscqueue.h"
+#include "inputlog.h"
+
 using namespace std;
 
 float LEFT_BOUND = -72.0f;
@@ -23,6 +46,20 @@ float BOTTOM_BOUND = -34.0f;
 float ZOOM_FACTOR = 2.0f;
 float WINDOW_WIDTH = 1300;
 float WINDOW_HEIGHT = 600;
+float PHYSICS_STEP = 0.01f;
+int MAX_STEPS_PER_FRAME = 10;
+int BOMB_POOL_SIZE = 1;
+bool SALVO_MODE = false;
+const char *LEVEL_FILE = NULL;     // level1.txt next to the executable
+const char *ASSET_PACK_FILE = NULL; // assets.pack next to the executable
+int HEADLESS_FRAMES = 0;           // > 0 renders offscreen with no window
+const char *HEADLESS_DUMP = NULL;  // PPM path, a %d in it gets the frame number
+const char *HEADLESS_LOG = NULL;   // per frame timings as CSV
+float HEADLESS_FRAME_TIME = 1.0f / 60.0f;
+const char *PROFILE_TRACE = "trace.json"; // written at exit and on X when built with -DPROFILE
+const char *RECORD_FILE = NULL;    // input log to write while playing
+const char *REPLAY_FILE = NULL;    // input log to check, no window or GL
+int RECORD_CHECK_TICKS = 100;      // ticks between state hashes in a recording
 
 
 
@@ -44,37 +81,245 @@ struct GLMatrices {
 	glm::mat4 projection;
 	glm::mat4 model;
 	glm::mat4 view;
-	GLuint MatrixID; // For use with normal shader
-	GLuint TexMatrixID; // For use with texture shader
+	GLuint PlacementID; // For use with normal shader
+	GLuint TexPlacementID; // For use with texture shader
 };
 typedef struct GLMatrices GLMatrices;
 
 GLMatrices Matrices;
-GLuint programID, fontProgramID, textureProgramID;
-GLint fontVertexCoordAttrib, fontVertexNormalAttrib, fontVertexOffsetUniform;
+GLuint programID, fontProgramID, textureProgramID, circleProgramID, rectProgramID;
+
+/* The Frame uniform block every shader declares. It holds the two
+ * view-projection matrices and is filled once per frame, objects only
+ * send their 2D placement. */
+struct FrameUniforms {
+	glm::mat4 sceneVP;
+	glm::mat4 screenVP;
+};
+GLuint frameUniformBuffer;
+const GLuint FRAME_BINDING = 0;
+
+/* All text of a frame in one draw call. Owns the single channel glyph
+ * atlas texture every FontFace packs its glyphs into, and a streaming
+ * vertex buffer the labels append their quads to. */
+class TextBatch{
+public:
+	TextBatch();
+	~TextBatch();
+	bool addGlyph(int width, int height, const unsigned char* pixels, int &atlasX, int &atlasY);
+	void add(std::vector<GLfloat> &quads, float x, float y, float scale, glm::vec3 &color);
+	void flush();
+	int getAtlasSize();
+	FT_Library getLibrary();
+private:
+	FT_Library library;
+	GLuint textureID;
+	GLuint VertexArrayID;
+	GLuint VertexBuffer;
+	int shelfX;
+	int shelfY;
+	int shelfHeight;
+	std::vector<GLfloat> vertices;
+};
+
+TextBatch *textBatch;
+
+/* An image ready for upload, every mip level down to 1x1 as tightly
+ * packed RGB. The levels point into the asset pack, or into pixels
+ * when the image was decoded from a loose file. */
+struct TextureData {
+	bool ok;
+	int width;
+	int height;
+	std::vector<const unsigned char*> levels;
+	std::vector<unsigned char> pixels;
+};
+
+/* Printable ASCII of one font file at one size, rasterized but not
+ * yet in the atlas. Sizes are in oversampled pixels. */
+struct GlyphSet {
+	struct Bitmap {
+		bool loaded;
+		int width, rows;
+		int left, top;
+		float advance;
+		std::vector<unsigned char> pixels;
+	};
+	std::string family;
+	Bitmap glyphs[95];
+};
+
+/* Decodes images and rasterizes fonts on worker threads while the main
+ * thread gets on with GL work. Everything is requested before start();
+ * texture() and font() then hand a result over, waiting for it if it
+ * is not done yet, and return NULL for anything never requested. All
+ * sizes of one font file go to the same worker so the file is parsed
+ * once. Results belong to the caller. */
+class AssetLoader{
+public:
+	AssetLoader();
+	~AssetLoader();
+	void requestTexture(const char* filename);
+	void requestFont(const char* fontfile, float size);
+	void start(int threads);
+	TextureData* texture(const char* filename);
+	GlyphSet* font(const char* fontfile, float size);
+private:
+	struct Job {
+		std::string file;
+		bool isFont;
+		std::vector<float> sizes;
+	};
+	void work();
+	void runFont(Job &job);
+	std::deque<Job> jobs;
+	std::vector<std::thread> workers;
+	std::set<std::string> textureRequests;
+	std::set<std::pair<std::string, float> > fontRequests;
+	std::map<std::string, TextureData*> textures;
+	std::map<std::pair<std::string, float>, GlyphSet*> fonts;
+	std::mutex lock;
+	std::condition_variable finished;
+};
 
-class FTGLFont{
+AssetLoader *loader;
+
+/* One font file at one point size, rasterized once into the batch's
+ * atlas. Covers printable ASCII, which is every string the game shows. */
+class FontFace{
+public:
+	FontFace(TextBatch *batch, const GlyphSet &glyphSet);
+	void layout(const char* word, std::vector<GLfloat> &quads);
+private:
+	struct Glyph {
+		float x0, y0, x1, y1; // quad around the pen, in points
+		float u0, v0, u1, v1;
+		float advance;
+	};
+	Glyph glyphs[95];
+};
+
+/* Hands out one FontFace per (file, size) and counts its users. Sizes
+ * the AssetLoader prepared are taken from it, any other size is
+ * rasterized here; a font file is then opened and parsed once however
+ * many sizes use it, and closed again with its last FontFace. Atlas
+ * space of a released face is not reclaimed. */
+class FontCache{
+public:
+	FontCache(TextBatch *batch);
+	~FontCache();
+	FontFace* acquire(const char* fontfile, float size);
+	void release(FontFace* font);
+	int getFaceCount();
+	int getFileCount();
+private:
+	struct FontFile {
+		FT_Face face;
+		int sizes; // FontFaces made from it that are still alive
+	};
+	struct CachedFace {
+		FontFace *font;
+		std::string fontfile;
+		bool ownsFile; // rasterized from the FontFile, not the loader
+		int refs;
+	};
+	TextBatch *batch;
+	std::map<std::string, FontFile> files;
+	std::map<std::pair<std::string, float>, CachedFace> faces;
+};
+
+FontCache *fontCache;
+
+/* A string drawn with a FontFace. Its quads are laid out again only
+ * when setWord() really changes the text. */
+class TextLabel{
 public:
-	FTGLFont(GLMatrices *mtx, float* color, char* fontfile, char *word, float size, float x, float y, float scaleFactor);
-	~FTGLFont();
+	TextLabel(GLMatrices *mtx, float* color, char* fontfile, char *word, float size, float x, float y, float scaleFactor);
+	~TextLabel();
 	void draw();
 	void setWord(char* word);
 	void setScaleFactor(float scaleFactor);
 	float getScaleFactor();
 private:
 	GLMatrices *mtx;
-	FTFont* font;
-	GLuint fontMatrixID;
-	GLuint fontColorID;
+	FontFace* font;
 	float scaleFactor;
 	float x;
 	float y;
   	glm::vec3 fontColor; 
-  	char* fontfile;
   	char* word;
+  	std::vector<GLfloat> quads;
+};
+
+/* One "Name:value" line of the HUD. The text is formatted and laid
+ * out again only when the value differs from the one on screen. */
+class HudField{
+public:
+	HudField(TextLabel *label, const char *name);
+	~HudField();
+	void setValue(int value);
+	void draw();
+private:
+	TextLabel *label;
+	char text[32];
+	int nameLength;
+	int value;
+	bool formatted;
+};
+
+/* The speed, shots and score lines in the top left corner */
+class Hud{
+public:
+	Hud(GLMatrices *mtx, float* color, char* fontfile, float size, float x, float y, float lineGap);
+	~Hud();
+	void update(int speed, int shots, int score);
+	void draw();
+private:
+	HudField *speed;
+	HudField *shots;
+	HudField *score;
+};
+
+/* Draws every circle of a frame with one glDrawArraysInstanced per
+ * tessellation level. Circle::draw() only queues an instance (centre,
+ * radius and color) and flush() sends them all at the end of the frame. */
+class CircleBatch{
+public:
+  CircleBatch();
+  ~CircleBatch();
+  void add(float cx, float cy, float radius, const float* color, int numPolygons);
+  void flush();
+private:
+  struct CircleMesh {
+    GLuint VertexArrayID;
+    GLuint VertexBuffer;
+    GLuint InstanceBuffer;
+    int NumVertices;
+    std::vector<GLfloat> instances;
+  };
+  CircleMesh* getMesh(int numPolygons);
+  std::map<int, CircleMesh*> meshes;
 };
 
-void handleCollisionsBlock();
+CircleBatch *circleBatch;
+
+/* Same idea for rectangles: one unit quad, and per instance the
+ * centre, size, angle about the z axis and color. All rectangles of a
+ * frame go out in a single instanced draw. */
+class RectBatch{
+public:
+  RectBatch();
+  ~RectBatch();
+  void add(float x, float y, float width, float height, float angle, const float* color);
+  void flush();
+private:
+  GLuint VertexArrayID;
+  GLuint VertexBuffer;
+  GLuint InstanceBuffer;
+  std::vector<GLfloat> instances;
+};
+
+RectBatch *rectBatch;
 
 class Circle{
 public:
@@ -89,12 +334,9 @@ public:
   float getCenterX();
   float getCenterY();
   float getRadius();
-  VAO* getVAO();
   void draw();
 private:
-  GLfloat *vertex_buffer_data;
-  GLfloat *color_buffer_data;
-  VAO *vaobj;
+  float color[3];
   float cx;
   float cy;
   float radius;
@@ -125,7 +367,6 @@ public:
   Rectangle(GLMatrices *mtx, float* color,float x = 0.0f, float y = 0.0f, float width = 2.0f, float height = 3.0f, float angle = 0.0f);
   Rectangle(const Rectangle& rect);
   ~Rectangle();
-  VAO* getVAO();
   float getTopLeftX();
   float getTopLeftY();
   float getWidth();
@@ -141,10 +382,8 @@ public:
   void setAxis(glm::vec3 &axis);
   virtual void draw();
 private:
-  GLfloat *vertex_buffer_data;
-  GLfloat *color_buffer_data;
   GLMatrices *mtx;
-  VAO *vaobj;
+  float color[3];
   float x;
   float y;
   float width;
@@ -152,84 +391,81 @@ private:
   float angle;
   glm::vec3 axis;
 };
-class Block;
-
-class Item{
-public:
-  Item(float mass, float x, float y, float ux, float uy, float radius);
-  virtual void applyForces(float timeInstance);
-  void applyGravity();
-  void applyNormalForce();
-  void applyAcceleration();
-  void applyPosition(float timeInstance);
-  virtual void applyOtherForces();
-  void applyCollisionGround();
-  void applyFriction();
-  bool checkCollisionGround();
-  bool checkStoppage();
-  void setSpeed(float ux, float uy);
-  void setPosition(float x, float y);
-  void setTime(float time);
-  float getPositionX();
-  float getPositionY();
-  friend bool checkCollisionItem(Item &first, Item &second, bool& flag);
-  friend void simulateCollisionItem(Item &first, Item &second);
-  friend void handleCollisionsItem();
-  
-  friend bool checkCollisionBlock(Item& ball, Block& obs);
-  friend void simulateCollisionBlock(Item& ball, Block &obs);
-  friend void handleCollisionsBlock();
-
-  friend bool checkCollisionWall(Item& ball);
-  friend void simulateCollisionWall(Item& ball);
-  friend void handleCollisionsWall(Item& ball);
-protected:
-  static const float GRAVITY = 75.0f;
-  static const float BOUNCE_COF = 0.4f;
-  static const float FRICTION_COF = 0.1f;
-  static const float OBS_BOUNCE_COF = 0.6f;
-  static const float WALL_BOUNCE_COF = 0.2f;
-  float mass;
-  float forceX;
-  float forceY;
-  float x;
-  float y;
+/* Where a body was after the last two physics steps, as the renderer
+ * sees it. Copied out on the simulation thread. */
+struct BodyState {
   float prevX;
   float prevY;
-  float ux;
-  float uy;
-  float ax;
-  float ay;
-  float time;
-  float radius;
-  bool collisionFlag;
+  float x;
+  float y;
+  bool present;
+};
+typedef struct BodyState BodyState;
+
+/* Everything draw() needs of the game, one physics step's worth.
+ * Published by the simulation and never changed once it is. */
+struct WorldSnapshot {
+  std::vector<BodyState> bombs;    // the cannon's pool, in pool order
+  std::vector<BodyState> blocks;   // in the world's obstacle order
+  std::vector<BodyState> targets;  // in the world's target order
+  float barrelAngle;
+  int speed;
+  int shotsLeft;
+  int score;
+  bool win;
+  bool loose;
+  float alpha;    // leftover time into the next step, in steps
+  double time;    // monotonicSeconds() when it was published
 };
+typedef struct WorldSnapshot WorldSnapshot;
 
-class Bomb : public Item{
+/* Draws a physics Item as a circle, from the Item's snapshot */
+class BallView{
 public:
-  Bomb(GLMatrices *mtx, float cx, float cy, float speedX, float speedY);
-  bool getDynamic();
-  void draw();
-  void applyForces(float timeInstance);
-  void setDynamic(bool value);
+  BallView(GLMatrices *mtx, float* color, Item* item, int numPolygons = 100);
+  ~BallView();
+  void draw(const BodyState &state, float alpha = 1.0f);
 private:
   Circle *circ;
-  bool dynamic;
 };
 
+/* Draws a physics Block as a rectangle, from the Block's snapshot */
+class BlockView{
+public:
+  BlockView(GLMatrices *mtx, Block* block);
+  ~BlockView();
+  void draw(const BodyState &state, float alpha = 1.0f);
+private:
+  Rectangle *rect;
+};
+
+/* The cannon's part of a saved game */
+struct CannonState {
+  float angle;
+  float bombInitSpeed;
+  int shotsLeft;
+  int poolNext;
+};
+typedef struct CannonState CannonState;
+
 class Cannon{
 public:
-  Cannon(GLMatrices *mtx, int x = LEFT_BOUND + 4, int y = BOTTOM_BOUND + 3);
+  Cannon(GLMatrices *mtx, World *world, int poolSize = 1, int x = LEFT_BOUND + 4, int y = BOTTOM_BOUND + 3);
   ~Cannon();
 
   void barrelUp();
   void barrelDown();
   void setBarrelAngle(float angle);
   void shoot();
-  void draw();
+  void setSalvo(bool value);
+  bool getSalvo();
+  void capture(WorldSnapshot &snapshot);
+  uint64_t stateHash(uint64_t hash);
+  CannonState getState();
+  void setState(const CannonState &state);
+  void draw(const WorldSnapshot &snapshot, float alpha = 1.0f);
   void increaseSpeed();
   void decreaseSpeed();
-  void applyForces(float timeInstance);
   void setBombInitSpeed(float speed);
   float getBombInitSpeed();
   int getShotsLeft();
@@ -237,53 +473,89 @@ private:
   Circle *tank;
   Rectangle *barrel;
   GLMatrices *mtx;
-  Bomb *ammo;
+  BombPool *ammo;
+  std::vector<BallView*> ammoViews;
+  float angle;   // the barrel's, owned by the simulation thread
   float bombInitSpeed;
   int shotsLeft;
-  bool ammoVisible;
+  bool salvo;
 };
-//Rectangle(GLMatrices *mtx, float* color,int x = 0, 
-//int y = 0, int width = 2, int height = 3, int angle = 0);
-class Block
-{
-public:
-  Block(GLMatrices *mtx, int x, int y, int width, int height, bool dynamic = false);
-  float getPositionY();
-  float getPositionX();
-  float getHeight();
-  float getWidth();
-  void draw();
-  void applyForces(float timeInstance);
-  bool isDynamic();
-  float getSpeed();
-  float getLeftBound();
-  float getRightBound();
-  friend bool checkCollisionBlock(Item& ball, Block& obs);
-  friend void simulateCollisionBlock(Item& ball, Block &obs);
-  friend void handleCollisionsBlock();
-private:
-  Rectangle *rect;
-  float leftBound;
-  float rightBound;
-  float speed;
-  float time;
-  bool dynamic;
+/* What the player does to the game, queued for the simulation thread */
+enum InputType {
+  INPUT_BARREL_UP,
+  INPUT_BARREL_DOWN,
+  INPUT_SPEED_UP,
+  INPUT_SPEED_DOWN,
+  INPUT_SHOOT,
+  INPUT_AIM,      // args: barrel angle, bomb speed
+  INPUT_BOUNDS,   // args: left, right, top, bottom
+  INPUT_CHECKPOINT,
+  INPUT_ROLLBACK  // back to the last checkpoint
 };
 
-class Target:public Item
-{
+/* Everything of a saved game that is not the World's, whose state
+ * follows it. Plain data, copied in and out with memcpy. */
+struct GameState {
+  CannonState cannon;
+  int score;
+  bool win;
+  bool loose;
+};
+typedef struct GameState GameState;
+
+struct GameInput {
+  int type;
+  float args[4];
+  double time;    // monotonicSeconds() when the callback saw it
+};
+typedef struct GameInput GameInput;
+
+const unsigned INPUT_QUEUE_SIZE = 256;
+
+/* Runs the physics at a fixed rate on a thread of its own and after
+ * every batch of steps publishes a WorldSnapshot through a triple
+ * buffer, so draw() reads the newest one without a lock and never
+ * waits on a step. Input only reaches the world through send(), from
+ * the GLFW callbacks on the main thread into a lock free ring, and is
+ * applied on the simulation thread at step boundaries. Headless runs
+ * call advance() themselves instead of start(), which keeps them
+ * deterministic. */
+class Simulation{
 public:
-  Target(GLMatrices *mtx, Block* pillar);
-  void draw();
-  void applyOtherForces();
-  void applyForces(float timeInstance);
-  bool isInContact();
+  Simulation();
+  ~Simulation();
+  void send(int type, float a = 0.0f, float b = 0.0f, float c = 0.0f, float d = 0.0f);
+  void advance(double elapsed, double now = INFINITY);
+  void start();
+  void stop();
+  WorldSnapshot& latest();
+  void setRecorder(InputLogWriter *recorder);
+  bool replay(InputLogReader &log);
+  uint64_t getTick();
+  size_t getStateSize();
+  void saveState(void *out);
+  bool loadState(const void *in);
 private:
-  Circle *circ;
-  Block *pillar;
+  void run();
+  void applyInputs(double until);
+  void applyInput(const GameInput &input);
+  void step();
+  void publish();
+  TripleBuffer<WorldSnapshot> snapshots;
+  SpscQueue<GameInput, INPUT_QUEUE_SIZE> inputs;
+  std::thread thread;
+  std::atomic<bool> running;
+  double accumulator;
+  uint64_t tick;               // physics steps taken
+  InputLogWriter *recorder;    // NULL unless recording
+  StateArena *checkpoint;      // one slot, for INPUT_CHECKPOINT
+  bool hasCheckpoint;
 };
+Simulation *simulation;
+InputLogWriter *recorder;
 
 bool gameSplash;
+// Written by the simulation only, draw() goes by the snapshot
 bool gameWin;
 bool gameLoose;
 int gameScore;
@@ -292,66 +564,181 @@ Image *background;
 Circle *c;
 Rectangle *r;
 Cannon *can;
-Block *b1;
-Target *t1;
-Block *b2;
-Target *t2;
-Block *b3;
-Target *t3;
-Block *b4;
-Target *t4;
-//Block *b5;
-//Target *t5;
-FTGLFont *f1;
-FTGLFont *f2;
-FTGLFont *f3;
-FTGLFont *fLoose;
-FTGLFont *fWin;
-FTGLFont *fScore;
-FTGLFont *fEnter;
-FTGLFont *fIns1;
-FTGLFont *fIns2;
-FTGLFont *fIns3;
-FTGLFont *fIns4;
-std::vector<Item*> movableList;
-std::vector<Block*> obstacleList;
-void handleCollisionsItem();
+World *world;
+std::vector<BlockView*> blockViews;
+std::vector<BallView*> targetViews;
+Level *level;
+TextLabel *f1;
+Hud *hud;
+TextLabel *fLoose;
+TextLabel *fWin;
+TextLabel *fEnter;
+TextLabel *fIns1;
+TextLabel *fIns2;
+TextLabel *fIns3;
+TextLabel *fIns4;
+
+bool SHADER_CACHE = true;
+const unsigned int PROGRAM_BINARY_MAGIC = 0x42505343; // "CSPB"
+
+AssetPack *assets;
+
+/* Path of name in the directory the executable lives in, so the game
+ * finds its data wherever it is started from */
+std::string besideExecutable(const char * name)
+{
+	char path[4096];
+	ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if(length <= 0)
+		return name;
+	path[length] = '\0';
+	char *slash = strrchr(path, '/');
+	if(slash == NULL)
+		return name;
+	slash[1] = '\0';
+	return std::string(path) + name;
+}
+
+/* Program binaries are cached next to the executable too, so every
+ * launch shares one cache wherever it is started from */
+const std::string& shaderCacheDir()
+{
+	static std::string dir = besideExecutable(".shader_cache");
+	return dir;
+}
+
+/* Whole file in one read, empty if it can not be opened */
+std::string readWholeFile(const char * path)
+{
+	std::ifstream stream(path, std::ios::in | std::ios::binary);
+	if(!stream.is_open())
+		return std::string();
+	std::stringstream buffer;
+	buffer << stream.rdbuf();
+	return buffer.str();
+}
+
+/* Bytes of a raw asset. Points straight into the mapped pack when the
+ * pack has it, otherwise the loose file is read into storage. */
+const char* assetBytes(const char * name, size_t &size, std::string &storage)
+{
+	const AssetEntry *entry = assets->isOpen() ? assets->find(name) : NULL;
+	if(entry != NULL && entry->type == ASSET_RAW){
+		size = entry->size;
+		return (const char*)assets->getData(entry);
+	}
+	storage = readWholeFile(name);
+	size = storage.size();
+	return storage.data();
+}
+
+/* FNV-1a over both sources and the driver strings, so an updated
+ * shader or a different GL gets a cache file of its own */
+unsigned long long hashProgramSources(const char *vertexCode, size_t vertexLength, const char *fragmentCode, size_t fragmentLength)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const char *parts[4] = { vertexCode, fragmentCode,
+	                         (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+	size_t lengths[4] = { vertexLength, fragmentLength, strlen(parts[2]), strlen(parts[3]) };
+	for(int p = 0; p < 4; p++){
+		for(size_t i = 0; i < lengths[p]; i++){
+			hash ^= (unsigned char)parts[p][i];
+			hash *= 1099511628211ULL;
+		}
+		hash *= 1099511628211ULL; // the '\0' between parts
+	}
+	return hash;
+}
+
+/* True if path held a binary the driver accepted and linked */
+bool loadProgramBinary(GLuint ProgramID, const char * path)
+{
+	FILE *file = fopen(path, "rb");
+	if(file == NULL)
+		return false;
+	unsigned int magic = 0;
+	GLenum format = 0;
+	GLint length = 0;
+	bool ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == PROGRAM_BINARY_MAGIC
+		&& fread(&format, sizeof(format), 1, file) == 1
+		&& fread(&length, sizeof(length), 1, file) == 1 && length > 0;
+	std::vector<char> binary;
+	if(ok){
+		binary.resize(length);
+		ok = fread(&binary[0], 1, length, file) == length;
+	}
+	fclose(file);
+	if(!ok)
+		return false;
+	glProgramBinary(ProgramID, format, &binary[0], length);
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	return Result == GL_TRUE;
+}
+
+/* Written to a temporary name first so a crash never leaves half a file */
+void saveProgramBinary(GLuint ProgramID, const char * path)
+{
+	GLint length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(ProgramID, length, NULL, &format, &binary[0]);
+	mkdir(shaderCacheDir().c_str(), 0755);
+	std::string temporary = std::string(path) + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "wb");
+	if(file == NULL)
+		return;
+	bool ok = fwrite(&PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC), 1, file) == 1
+		&& fwrite(&format, sizeof(format), 1, file) == 1
+		&& fwrite(&length, sizeof(length), 1, file) == 1
+		&& fwrite(&binary[0], 1, length, file) == length;
+	ok = (fclose(file) == 0) && ok;
+	if(ok)
+		rename(temporary.c_str(), path);
+	else
+		remove(temporary.c_str());
+}
 
 /* Function to load Shaders - Use it as it is */
+/* Tries the program binary cache first and only compiles on a miss */
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
 
+	// Shader code from the pack, or the loose files without one
+	std::string VertexStorage, FragmentStorage;
+	size_t VertexLength, FragmentLength;
+	const char * VertexShaderCode = assetBytes(vertex_file_path, VertexLength, VertexStorage);
+	const char * FragmentShaderCode = assetBytes(fragment_file_path, FragmentLength, FragmentStorage);
+
+	GLuint ProgramID = glCreateProgram();
+	std::string cachePath;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	bool useCache = SHADER_CACHE && formats > 0;
+	if(useCache){
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.bin",
+		         hashProgramSources(VertexShaderCode, VertexLength, FragmentShaderCode, FragmentLength));
+		cachePath = shaderCacheDir() + name;
+		if(loadProgramBinary(ProgramID, cachePath.c_str())){
+			printf("Loaded cached program : %s + %s\n", vertex_file_path, fragment_file_path);
+			return ProgramID;
+		}
+	}
+
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
 	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-                                        
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open())
-	{
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}
-
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
 	// Compile Vertex Shader
 	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
+	GLint VertexSourceLength = VertexLength;
+	glShaderSource(VertexShaderID, 1, &VertexShaderCode , &VertexSourceLength);
 	glCompileShader(VertexShaderID);
 
 	// Check Vertex Shader
@@ -363,8 +750,8 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 
 	// Compile Fragment Shader
 	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
+	GLint FragmentSourceLength = FragmentLength;
+	glShaderSource(FragmentShaderID, 1, &FragmentShaderCode , &FragmentSourceLength);
 	glCompileShader(FragmentShaderID);
 
 	// Check Fragment Shader
@@ -376,7 +763,8 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 
 	// Link the program
 	fprintf(stdout, "Linking program\n");
-	GLuint ProgramID = glCreateProgram();
+	if(useCache)
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
 	glLinkProgram(ProgramID);
@@ -391,16 +779,57 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	if(useCache && Result == GL_TRUE)
+		saveProgramBinary(ProgramID, cachePath.c_str());
+
 	return ProgramID;
 }
 
+/* Creates the Frame uniform buffer */
+void initFrameUniforms()
+{
+	glGenBuffers(1, &frameUniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frameUniformBuffer);
+}
+
+/* Points a program's Frame block at the buffer, once per program */
+void bindFrameUniforms(GLuint program)
+{
+	GLuint block = glGetUniformBlockIndex(program, "Frame");
+	if(block != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, block, FRAME_BINDING);
+}
+
+/* The only 4x4 multiplies of a frame, everything else is done per
+ * vertex in the shaders */
+void updateFrameUniforms()
+{
+	FrameUniforms frame;
+	frame.sceneVP = Matrices.projection * Matrices.view;
+	frame.screenVP = Matrices.projection * glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0));
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+}
+
 static void error_callback(int error, const char* description)
 {
     fprintf(stderr, "Error: %s\n", description);
 }
 
+/* Writes the profiler's trace, a no-op unless built with -DPROFILE */
+void exportTrace()
+{
+	if(profileExport(PROFILE_TRACE))
+		cout << "Trace written to " << PROFILE_TRACE << endl;
+}
+
 void quit(GLFWwindow *window)
 {
+    if(simulation != NULL)
+        simulation->stop();
+    exportTrace();
     glfwDestroyWindow(window);
     glfwTerminate();
     exit(EXIT_SUCCESS);
@@ -494,9 +923,60 @@ void draw3DTexturedObject (struct VAO* vao)
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-/* Create an OpenGL Texture from an image */
+/* CPU half of loading a texture, safe on any thread. A baked texture
+ * only needs its levels pointed at, a loose image is decoded and its
+ * mip chain built here instead of by glGenerateMipmap. */
+void decodeTexture (const char* filename, TextureData &data)
+{
+	data.ok = false;
+	data.levels.clear();
+	const AssetEntry *entry = assets->isOpen() ? assets->find(filename) : NULL;
+	if(entry != NULL && entry->type == ASSET_TEXTURE_RGB){
+		data.width = entry->width;
+		data.height = entry->height;
+		for(int level = 0; level < entry->levels; level++){
+			int lwidth, lheight;
+			data.levels.push_back(assets->getLevel(entry, level, lwidth, lheight));
+		}
+		data.ok = true;
+		return;
+	}
+
+	unsigned char* image = SOIL_load_image(filename, &data.width, &data.height, 0, SOIL_LOAD_RGB);
+	if(image == NULL)
+		return;
+	int levels = textureLevelCount(data.width, data.height);
+	size_t total = 0;
+	for(int level = 0; level < levels; level++)
+		total += textureLevelSize(data.width, data.height, level);
+	data.pixels.resize(total);
+	memcpy(&data.pixels[0], image, textureLevelSize(data.width, data.height, 0));
+	SOIL_free_image_data(image); // Free the data read from file once it is copied
+	size_t offset = 0;
+	for(int level = 0; level < levels; level++){
+		data.levels.push_back(&data.pixels[offset]);
+		if(level + 1 < levels)
+			downsampleRGB(&data.pixels[offset], max(1, data.width >> level), max(1, data.height >> level),
+			              &data.pixels[offset + textureLevelSize(data.width, data.height, level)]);
+		offset += textureLevelSize(data.width, data.height, level);
+	}
+	data.ok = true;
+}
+
+/* Create an OpenGL Texture from an image, 0 if it could not be read */
+/* Takes the image from the loader if it was requested there */
 GLuint createTexture (const char* filename)
 {
+	TextureData *data = loader != NULL ? loader->texture(filename) : NULL;
+	if(data == NULL){
+		data = new TextureData();
+		decodeTexture(filename, *data);
+	}
+	if(!data->ok){
+		delete data;
+		return 0;
+	}
+
 	GLuint TextureID;
 	// Generate Texture Buffer
 	glGenTextures(1, &TextureID);
@@ -510,13 +990,16 @@ GLuint createTexture (const char* filename)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	// Load image and create OpenGL texture
-	int twidth, theight;
-	unsigned char* image = SOIL_load_image(filename, &twidth, &theight, 0, SOIL_LOAD_RGB);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, twidth, theight, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	glGenerateMipmap(GL_TEXTURE_2D); // Generate MipMaps to use
-	SOIL_free_image_data(image); // Free the data read from file after creating opengl texture
+	// Every level is handed over as it is, straight from the pack when
+	// the texture was baked
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // levels are tightly packed RGB
+	for(int level = 0; level < data->levels.size(); level++)
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, max(1, data->width >> level), max(1, data->height >> level), 0,
+		             GL_RGB, GL_UNSIGNED_BYTE, data->levels[level]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, data->levels.size() - 1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture when done, so we won't accidentily mess it up
+	delete data;
 
 	return TextureID;
 }
@@ -602,69 +1085,175 @@ void draw3DObject (struct VAO* vao)
 
 
 
+CircleBatch::CircleBatch(){
+}
+
+CircleBatch::~CircleBatch(){
+  for(std::map<int, CircleMesh*>::iterator it = meshes.begin(); it != meshes.end(); ++it){
+    CircleMesh *mesh = it->second;
+    glDeleteBuffers(1, &mesh->VertexBuffer);
+    glDeleteBuffers(1, &mesh->InstanceBuffer);
+    glDeleteVertexArrays(1, &mesh->VertexArrayID);
+    delete mesh;
+  }
+}
+
+/* Unit circle as a triangle fan, built the first time a circle with
+ * that many polygons is drawn and shared by all of them afterwards */
+CircleBatch::CircleMesh* CircleBatch::getMesh(int numPolygons){
+  std::map<int, CircleMesh*>::iterator found = meshes.find(numPolygons);
+  if(found != meshes.end())
+    return found->second;
+
+  CircleMesh *mesh = new CircleMesh;
+  mesh->NumVertices = numPolygons + 2;
+  std::vector<GLfloat> vertex_buffer_data(3 * mesh->NumVertices, 0.0f);
+  for(int i = 0; i <= numPolygons; i++){
+    float theta = 2.0f * 3.1415926f * float(i) / float(numPolygons);
+    vertex_buffer_data[3*(i + 1) + 0] = cosf(theta);
+    vertex_buffer_data[3*(i + 1) + 1] = sinf(theta);
+  }
+
+  glGenVertexArrays(1, &(mesh->VertexArrayID));
+  glGenBuffers(1, &(mesh->VertexBuffer));
+  glGenBuffers(1, &(mesh->InstanceBuffer));
+  glBindVertexArray(mesh->VertexArrayID);
+
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->VertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertex_buffer_data.size()*sizeof(GLfloat), &vertex_buffer_data[0], GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+  // Instance layout: cx, cy, radius, r, g, b
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->InstanceBuffer);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)0);
+  glVertexAttribDivisor(2, 1);
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)(3*sizeof(GLfloat)));
+  glVertexAttribDivisor(3, 1);
+
+  meshes[numPolygons] = mesh;
+  return mesh;
+}
+
+void CircleBatch::add(float cx, float cy, float radius, const float* color, int numPolygons){
+  std::vector<GLfloat> &instances = getMesh(numPolygons)->instances;
+  instances.push_back(cx);
+  instances.push_back(cy);
+  instances.push_back(radius);
+  instances.push_back(color[0]);
+  instances.push_back(color[1]);
+  instances.push_back(color[2]);
+}
+
+/* One upload and one draw call per tessellation level. The instance
+ * buffer is orphaned every frame so the driver never has to wait on
+ * the previous frame still reading it. */
+void CircleBatch::flush(){
+  glUseProgram(circleProgramID);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  for(std::map<int, CircleMesh*>::iterator it = meshes.begin(); it != meshes.end(); ++it){
+    CircleMesh *mesh = it->second;
+    if(mesh->instances.empty())
+      continue;
+    GLsizeiptr bytes = mesh->instances.size()*sizeof(GLfloat);
+    glBindVertexArray(mesh->VertexArrayID);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->InstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &mesh->instances[0]);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, mesh->NumVertices, mesh->instances.size() / 6);
+    // clear() keeps the capacity, so steady frames do not allocate
+    mesh->instances.clear();
+  }
+}
+
+
+RectBatch::RectBatch(){
+  // Two triangles, as the old per rectangle VAO had them
+  static const GLfloat vertex_buffer_data[] = {
+    0.5f, 0.5f, 0,  0.5f, -0.5f, 0,  -0.5f, -0.5f, 0,
+    0.5f, 0.5f, 0,  -0.5f, 0.5f, 0,  -0.5f, -0.5f, 0
+  };
+  glGenVertexArrays(1, &VertexArrayID);
+  glGenBuffers(1, &VertexBuffer);
+  glGenBuffers(1, &InstanceBuffer);
+  glBindVertexArray(VertexArrayID);
+
+  glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+  // Instance layout: x, y, width, height, angle, r, g, b
+  glBindBuffer(GL_ARRAY_BUFFER, InstanceBuffer);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), (void*)0);
+  glVertexAttribDivisor(2, 1);
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), (void*)(4*sizeof(GLfloat)));
+  glVertexAttribDivisor(3, 1);
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), (void*)(5*sizeof(GLfloat)));
+  glVertexAttribDivisor(4, 1);
+}
+
+RectBatch::~RectBatch(){
+  glDeleteBuffers(1, &VertexBuffer);
+  glDeleteBuffers(1, &InstanceBuffer);
+  glDeleteVertexArrays(1, &VertexArrayID);
+}
+
+void RectBatch::add(float x, float y, float width, float height, float angle, const float* color){
+  instances.push_back(x);
+  instances.push_back(y);
+  instances.push_back(width);
+  instances.push_back(height);
+  instances.push_back(angle);
+  instances.push_back(color[0]);
+  instances.push_back(color[1]);
+  instances.push_back(color[2]);
+}
+
+void RectBatch::flush(){
+  if(instances.empty())
+    return;
+  glUseProgram(rectProgramID);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  GLsizeiptr bytes = instances.size()*sizeof(GLfloat);
+  glBindVertexArray(VertexArrayID);
+  glBindBuffer(GL_ARRAY_BUFFER, InstanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &instances[0]);
+  glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instances.size() / 8);
+  instances.clear();
+}
+
 /**************************
  * Customizable functions *
  **************************/
 
 Circle::Circle(GLMatrices *mtx, float* color, float cx, float cy, float radius, int numPolygons)
 {
-  vertex_buffer_data = new GLfloat[500 * 9];
-  color_buffer_data = new GLfloat[500 * 9];
   this->cx = cx;
   this->cy = cy;
   this->radius = radius;
   this->numPolygons = numPolygons;
   this->mtx = mtx;
-  float theta;
-  for(int i = 0; i <= numPolygons; i++)
-  {
-    //Adding vertices
-    theta = 2.0f * 3.1415926f * float(i) / float(numPolygons);
-    if(i==0){
-      vertex_buffer_data[9*i + 0] = radius;
-      vertex_buffer_data[9*i + 1] = 0;
-      vertex_buffer_data[9*i + 2] = 0;
-    }
-    else{
-      vertex_buffer_data[9*i + 0] = vertex_buffer_data[9*i - 3];
-      vertex_buffer_data[9*i + 1] = vertex_buffer_data[9*i - 2];
-      vertex_buffer_data[9*i + 2] = vertex_buffer_data[9*i - 1];
-    }
-
-    vertex_buffer_data[9*i + 3] =  0;
-    vertex_buffer_data[9*i + 4] =  0;
-    vertex_buffer_data[9*i + 5] =  0;
-
-    vertex_buffer_data[9*i + 6] =  radius * cosf(theta);
-    vertex_buffer_data[9*i + 7] =  radius * sinf(theta);
-    vertex_buffer_data[9*i + 8] =  0;
-
-    //Adding color
-    for(int j=0;j<9;j+=3){
-      color_buffer_data[9*i + j + 0] = color[0];
-      color_buffer_data[9*i + j + 1] = color[1];
-      color_buffer_data[9*i + j + 2] = color[2];
-    }
-  }
-  vaobj = create3DObject(GL_TRIANGLES, 3*numPolygons + 3, vertex_buffer_data, color_buffer_data, GL_FILL);
-
+  for(int j = 0; j < 3; j++)
+    this->color[j] = color[j];
 }
 
 //copy constructor
 Circle::Circle(const Circle& circ){
   cout<<"Entered circle copy constructor"<<endl;
-  vertex_buffer_data = new GLfloat[500 * 9];
-  color_buffer_data = new GLfloat[500 * 9];
   this->cx = circ.cx;
   this->cy = circ.cy;
   this->radius = circ.radius;
   this->numPolygons = circ.numPolygons;
   this->mtx = circ.mtx;
-  for(int i = 0; i <= 9*numPolygons; i++){
-      vertex_buffer_data[i] = circ.vertex_buffer_data[i];
-      color_buffer_data[i] = circ.color_buffer_data[i];
-  }
-  vaobj = create3DObject(GL_TRIANGLES, 3*numPolygons + 3, vertex_buffer_data, color_buffer_data, GL_FILL);
+  for(int j = 0; j < 3; j++)
+    this->color[j] = circ.color[j];
 }
 
 void Circle::setCenter(float x, float y){
@@ -692,37 +1281,14 @@ float Circle::getRadius(){
   return radius;
 }
 
-VAO* Circle::getVAO(){
-  return vaobj;
-}
-
+/* Queued, the circle reaches the screen when the batch is flushed */
 void Circle::draw(){
-  //std::cout<<"Entered draw funtion"<<cx<<endl;
-  glm::mat4 MVP; // MVP = Projection * View * Model
-  // Load identity to model matrix
-  mtx->model = glm::mat4(1.0f);
-
-  /* Render your scene */
-  //std::cout<<"Centre = X - "<<cx<<endl;
-  //std::cout<<"Centre = Y - "<<cy<<endl;
-  glm::mat4 mtranslate = glm::translate (glm::vec3(cx, cy, 0.0f)); // glTranslatef
-  //glm::mat4 rotateTriangle = glm::rotate((float)(triangle_rotation*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
-  glm::mat4 mtransform = mtranslate;
-  mtx->model *= mtransform;
-  MVP =  mtx->projection * mtx->view * mtx->model; // MVP = p * V * M
-
-  //  Don't change unless you are sure!!
-  glUniformMatrix4fv(mtx->MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  draw3DObject(vaobj);
-
+  circleBatch->add(cx, cy, radius, color, numPolygons);
 }
 
 void Circle::swap(Circle &first, Circle &second){
   using std::swap;
-  swap(first.vertex_buffer_data, second.vertex_buffer_data);
-  swap(first.color_buffer_data, second.color_buffer_data);
-  swap(first.vaobj, second.vaobj);
+  swap(first.color, second.color);
   swap(first.cx, second.cx);
   swap(first.cy, second.cy);
   swap(first.radius, second.radius);
@@ -739,8 +1305,6 @@ Circle& Circle::operator=(Circle other) // (1)
 }
 
 Circle::~Circle(){
-  delete[] vertex_buffer_data;
-  delete[] color_buffer_data;
 }
 
 Image::Image(GLMatrices *mtx, GLuint textureID, float x, float y, float width, float height, float angle)
@@ -799,20 +1363,11 @@ Image::Image(GLMatrices *mtx, GLuint textureID, float x, float y, float width, f
   vaobj = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data, texture_buffer_data, textureID, GL_FILL);
 }
 
+/* Drawn with the fixed screen camera, it is not moved by the pan */
 void Image::draw(){
-  glm::mat4 MVP; // MVP = Projection * View * Model
-  // Load identity to model matrix
-  mtx->model = glm::mat4(1.0f);
-
-  /* Render your scene */
-  glm::mat4 mrotate = glm::rotate((float)(angle*M_PI/180.0f), axis);  // rotate about vector axis
-  glm::mat4 mtranslate = glm::translate (glm::vec3((float)x, (float)y, 0.0f)); // glTranslatef
-  glm::mat4 mtransform = mtranslate * mrotate;
-  mtx->model *= mtransform;
-  MVP =  mtx->projection * mtx->view * mtx->model; // MVP = p * V * M
-
-  //  Don't change unless you are sure!!
-  glUniformMatrix4fv(mtx->TexMatrixID, 1, GL_FALSE, &MVP[0][0]);
+  // The shader rotates about z and translates, the view-projection
+  // comes from the Frame block
+  glUniform3f(mtx->TexPlacementID, x, y, (float)(angle*M_PI/180.0f));
   glUniform1i(glGetUniformLocation(textureProgramID, "texSampler"), 0);
   draw3DTexturedObject(vaobj);
 
@@ -820,8 +1375,6 @@ void Image::draw(){
 
 Rectangle::Rectangle(GLMatrices *mtx, float* color,float x, float y, float width, float height, float angle)
 {
-  vertex_buffer_data = new GLfloat[20];
-  color_buffer_data = new GLfloat[20];
   this->mtx = mtx;
   this->x = x;
   this->y = y;
@@ -829,45 +1382,11 @@ Rectangle::Rectangle(GLMatrices *mtx, float* color,float x, float y, float width
   this->height = height;
   this->angle = angle;
   this->axis = glm::vec3(0.0f,0.0f,1.0f);
-
-  //First triangle
-  vertex_buffer_data[0] = width/2;    //1
-  vertex_buffer_data[1] = height/2;
-  vertex_buffer_data[2] = 0;		
-
-  vertex_buffer_data[3] = width/2;	   //2
-  vertex_buffer_data[4] = -1*height/2;
-  vertex_buffer_data[5] = 0;
-
-  vertex_buffer_data[6] = -1*width/2;  //3
-  vertex_buffer_data[7] = -1*height/2;
-  vertex_buffer_data[8] = 0;
-
-  //Second Triangle
-  vertex_buffer_data[9] = width/2;	  //1
-  vertex_buffer_data[10] = height/2;
-  vertex_buffer_data[11] = 0;
-
-  vertex_buffer_data[12] = -1*width/2;	//4
-  vertex_buffer_data[13] = height/2;
-  vertex_buffer_data[14] = 0;
-
-  vertex_buffer_data[15] = -1*width/2;	//3
-  vertex_buffer_data[16] = -1*height/2;
-  vertex_buffer_data[17] = 0;
-
-  //Coloring
-  for(int j=0;j<18;j+=3){
-    color_buffer_data[j + 0] = color[0];
-    color_buffer_data[j + 1] = color[1];
-    color_buffer_data[j + 2] = color[2];
-  }
-  vaobj = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+  for(int j = 0; j < 3; j++)
+    this->color[j] = color[j];
 }
 
 Rectangle::Rectangle(const Rectangle& rect){
-  vertex_buffer_data = new GLfloat[20];
-  color_buffer_data = new GLfloat[20];
   this->mtx = rect.mtx;
   this->x = rect.x;
   this->y = rect.y;
@@ -875,15 +1394,8 @@ Rectangle::Rectangle(const Rectangle& rect){
   this->height = rect.height;
   this->angle = rect.angle;
   this->axis = rect.axis;
-  for(int i = 0; i<18; i++){
-    vertex_buffer_data[i] = rect.vertex_buffer_data[i];
-    color_buffer_data[i] = rect.vertex_buffer_data[i];
-  }
-  vaobj = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-
-VAO* Rectangle::getVAO(){
-  return this->vaobj;
+  for(int j = 0; j < 3; j++)
+    this->color[j] = rect.color[j];
 }
 
 float Rectangle::getTopLeftX(){
@@ -940,30 +1452,16 @@ void Rectangle::setAxis(glm::vec3 &axis){
   this->axis = axis;
 }
 
+/* Queued like Circle::draw(). The batch only rotates about z, the
+ * one axis any rectangle in the game uses. */
 void Rectangle::draw(){
-  glm::mat4 MVP; // MVP = Projection * View * Model
-  // Load identity to model matrix
-  mtx->model = glm::mat4(1.0f);
-
-  /* Render your scene */
-  glm::mat4 mrotate = glm::rotate((float)(angle*M_PI/180.0f), axis);  // rotate about vector axis
-  glm::mat4 mtranslate = glm::translate (glm::vec3((float)x, (float)y, 0.0f)); // glTranslatef
-  glm::mat4 mtransform = mtranslate * mrotate;
-  mtx->model *= mtransform;
-  MVP =  mtx->projection * mtx->view * mtx->model; // MVP = p * V * M
-
-  //  Don't change unless you are sure!!
-  glUniformMatrix4fv(mtx->MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  draw3DObject(vaobj);
+  rectBatch->add(x, y, width, height, (float)(angle*M_PI/180.0f), color);
 }
 
 Rectangle::~Rectangle(){
-  delete[] vertex_buffer_data;
-  delete[] color_buffer_data;
 }
 
-Cannon::Cannon(GLMatrices *mtx, int x, int y){
+Cannon::Cannon(GLMatrices *mtx, World *world, int poolSize, int x, int y){
   //Circle(GLMatrices *mtx, int cx=0, int cy=0, int radius=3, 
   //int numPolygons =100, float color=0.5);
   //Rectangle(GLMatrices *mtx, int x, int y, 
@@ -982,15 +1480,21 @@ Cannon::Cannon(GLMatrices *mtx, int x, int y){
   barrel = new Rectangle(mtx,colorBarrel,x, y, 4.0f, 16.0f, -70.0f);
   glm::vec3 mtemp = glm::vec3(0, 0, 1);
   barrel->setAxis(mtemp);
+  angle = barrel->getAngle();
   float radAngle = barrel->getPosAngle() * M_PI/180.0f;
   float cx = tank->getCenterX() + (barrel->getHeight()/2)*cosf(radAngle);
   float cy = tank->getCenterY() + (barrel->getHeight()/2)*sinf(radAngle);
   bombInitSpeed = 80.0f;
-  float ux = bombInitSpeed*cosf(radAngle);
-  float uy = bombInitSpeed*sinf(radAngle);  
-  this->ammo = new Bomb(mtx, cx, cy, ux, uy); 
-  movableList.push_back(this->ammo);
-  ammoVisible = false;
+  // Every bomb and its mesh is made here, shooting only reuses them
+  this->ammo = new BombPool(world, poolSize, cx, cy);
+  float *colorBomb = new float[3];
+  colorBomb[0] = 0.545;
+  colorBomb[1] = 0;
+  colorBomb[2] = 0;
+  for(int k = 0; k < poolSize; k++)
+    this->ammoViews.push_back(new BallView(mtx, colorBomb, this->ammo->getBomb(k), 50));
+  delete[] colorBomb;
+  salvo = false;
   delete colorTank;
   delete colorBarrel;
 }
@@ -998,24 +1502,73 @@ Cannon::Cannon(GLMatrices *mtx, int x, int y){
 Cannon::~Cannon(){
   delete tank;
   delete barrel;
+  for(int k = 0; k < ammoViews.size(); k++)
+    delete ammoViews[k];
+  delete ammo;
 }
 
 void Cannon::setBombInitSpeed(float speed){
 	this->bombInitSpeed = speed;
 }
-void Cannon::draw(){
-  if(ammoVisible){
-    ammo->draw();
+/* Copies the cannon's part of the game into a snapshot, on the
+ * simulation thread */
+void Cannon::capture(WorldSnapshot &snapshot){
+  snapshot.bombs.resize(ammo->getCapacity());
+  for(int k = 0; k < ammo->getCapacity(); k++){
+    Bomb *bomb = ammo->getBomb(k);
+    BodyState &state = snapshot.bombs[k];
+    state.prevX = bomb->getPrevPositionX();
+    state.prevY = bomb->getPrevPositionY();
+    state.x = bomb->getPositionX();
+    state.y = bomb->getPositionY();
+    state.present = bomb->isPresent();
+  }
+  snapshot.barrelAngle = angle;
+  snapshot.speed = (int)bombInitSpeed;
+  snapshot.shotsLeft = shotsLeft;
+}
+
+/* The cannon's part of the game state, chained on to hash */
+uint64_t Cannon::stateHash(uint64_t hash){
+  float aim[2] = {angle, bombInitSpeed};
+  hash = hashBytes(hash, aim, sizeof(aim));
+  return hashBytes(hash, &shotsLeft, sizeof(shotsLeft));
+}
+
+CannonState Cannon::getState(){
+  CannonState state;
+  state.angle = angle;
+  state.bombInitSpeed = bombInitSpeed;
+  state.shotsLeft = shotsLeft;
+  state.poolNext = ammo->getNext();
+  return state;
+}
+
+/* The bombs themselves are the World's and are restored with it */
+void Cannon::setState(const CannonState &state){
+  angle = state.angle;
+  bombInitSpeed = state.bombInitSpeed;
+  shotsLeft = state.shotsLeft;
+  ammo->setNext(state.poolNext);
+}
+
+/* Draws from the snapshot alone, the bombs and angle here belong to
+ * the simulation thread */
+void Cannon::draw(const WorldSnapshot &snapshot, float alpha){
+  for(int k = 0; k < ammoViews.size(); k++){
+    if(snapshot.bombs[k].present)
+      ammoViews[k]->draw(snapshot.bombs[k], alpha);
   }
+  barrel->setAngle(snapshot.barrelAngle);
   barrel->draw();
   tank->draw();
 }
 
 void Cannon::barrelUp(){
-  int currentAngle = barrel->getAngle();
+  int currentAngle = angle;
   currentAngle += 2;
   if(currentAngle >=0 )currentAngle = 0;
-  barrel->setAngle(currentAngle);
+  angle = currentAngle;
 }
 
 float Cannon::getBombInitSpeed(){
@@ -1026,7 +1579,7 @@ void Cannon::setBarrelAngle(float angle){
 	float currentAngle = angle;
 	if(currentAngle >=0 )currentAngle = 0;
 	else if(currentAngle <= -90 )currentAngle = -90;
-	barrel->setAngle(angle);
+	this->angle = angle;
 }
 
 void Cannon::increaseSpeed(){
@@ -1046,18 +1599,27 @@ int Cannon::getShotsLeft(){
 
 
 void Cannon::barrelDown(){
-  int currentAngle = barrel->getAngle();
+  int currentAngle = angle;
   currentAngle -= 2;
   if(currentAngle <= -90 )currentAngle = -90;
-  barrel->setAngle(currentAngle);
+  angle = currentAngle;
+}
+
+/* In salvo mode shots are not counted, so a held key can keep the
+ * whole pool in the air */
+void Cannon::setSalvo(bool value){
+  this->salvo = value;
+}
+
+bool Cannon::getSalvo(){
+  return salvo;
 }
 
 void Cannon::shoot(){
-  ammoVisible = true;
-  if(!this->ammo->getDynamic()){
+  if(this->ammo->getInFlight() < this->ammo->getCapacity()){
     //cout<<"Tank centre - (x,) = "<<tank->getCenterX()<<" , "<<tank->getCenterY()<<endl;
     //cout<<"Angle - "<<barrel->getPosAngle()<<endl;
-    float radAngle = barrel->getPosAngle() * M_PI/180.0f;
+    float radAngle = (angle + 90.0f) * M_PI/180.0f;
     float xAdd = (barrel->getHeight()/2)*cosf(radAngle);
     float yAdd = (barrel->getHeight()/2)*sinf(radAngle);
     //cout<<"X addition - "<<xAdd<<endl;
@@ -1071,377 +1633,554 @@ void Cannon::shoot(){
     float uy = bombInitSpeed*sinf(radAngle); 
     //cout<<"Bomb speed X "<<ux<<endl; 
     //cout<<"Bomb speed Y "<<uy<<endl; 
-    this->ammo->setPosition(cx, cy);
-    this->ammo->setSpeed(ux, uy);
-    this->ammo->setTime(0.0f);
-    this->ammo->setDynamic(true);
-    shotsLeft--;
+    this->ammo->fire(cx, cy, ux, uy);
+    if(!salvo)
+      shotsLeft--;
   }
   
 }
 
-void Cannon::applyForces(float timeInstance){
-  if(ammo){
-    ammo->applyForces(timeInstance);
-  }    
+BallView::BallView(GLMatrices *mtx, float* color, Item* item, int numPolygons){
+  this->circ = new Circle(mtx, color, item->getPositionX(), item->getPositionY(), item->getRadius(), numPolygons);
 }
 
-Bomb::Bomb(GLMatrices *mtx, float cx, float cy, float speedX, float speedY)
-  : Item(5.0f, cx, cy, speedX, speedY, 2.0f)
-{
-  float *colorCirc = new float[3];
-  colorCirc[0] = 0.545;
-  colorCirc[1] = 0;
-  colorCirc[2] = 0;
-  this->circ = new Circle(mtx, colorCirc, cx, cy, radius, 50);
-  this->dynamic = false;
-  this->collisionFlag = true;
-  delete[] colorCirc;
+BallView::~BallView(){
+  delete circ;
 }
 
-
-void Bomb::draw(){
+/* alpha is how far the frame is between the last two physics steps */
+void BallView::draw(const BodyState &state, float alpha){
+  circ->setCenter(state.prevX + (state.x - state.prevX) * alpha, state.prevY + (state.y - state.prevY) * alpha);
   circ->draw();
 }
 
-void Bomb::applyForces(float timeInstance){
-  if(dynamic){
-    Item::applyForces(timeInstance);
-    /*
-    time += timeInstance;
-    //cout<<"SpeedX = "<<speedX<<" SpeedY "<<speedY<<endl;
-    //cout<<"Before (x,y) -> "<<circ->getCenterX()<<" , "<<circ->getCenterY()<<endl;
-    float x = circ->getCenterX() + speedX * time;
-    float y = circ->getCenterY() + speedY * time - (0.5f * GRAVITY * time * time);
-    //cout<<"After (x,y) -> "<<x<<" , "<<y<<endl;
-    setPosition(x,y);
-    */
-    float tx = getPositionX();
-    float ty = getPositionY();
-    circ->setCenter(tx,ty);
-    float yrp = y - this->circ->getRadius();
-    float xrp = x - this->circ->getRadius();
-
-    if(xrp > RIGHT_BOUND || xrp < LEFT_BOUND || this->checkStoppage())
-    {
-      this->setDynamic(false);
-    }
-    
-  }
-}
-
-void Bomb::setDynamic(bool value){
-  this->dynamic = value;
+BlockView::BlockView(GLMatrices *mtx, Block* block){
+  float *colorBlock = new float[3];
+  colorBlock[0] = 0.6;
+  colorBlock[1] = 0.298;
+  colorBlock[2] = 0.0f;
+  this->rect = new Rectangle(mtx, colorBlock, block->getPositionX(), block->getPositionY(), block->getWidth(), block->getHeight(), 0);
+  delete[] colorBlock;
 }
 
-bool Bomb::getDynamic(){
-  return this->dynamic;
+BlockView::~BlockView(){
+  delete rect;
 }
 
-Item::Item(float mass, float x, float y, float ux, float uy, float radius){
-  this->mass = mass;
-  this->prevX = x;
-  this->prevY = y;
-  this->x = x;
-  this->y = y;
-  this->ux = ux;
-  this->uy = uy;
-  this->radius = radius;
-  this->forceX = 0.0f;
-  this->forceY = 0.0f;
-  this->ax = 0.0f;
-  this->ay = 0.0f;
-  this->time = 0.0f;
+void BlockView::draw(const BodyState &state, float alpha){
+  rect->setTopLeftX(state.prevX + (state.x - state.prevX) * alpha);
+  rect->setTopLeftY(state.y);
+  rect->draw();
 }
 
+const int TEXT_ATLAS_SIZE = 2048;
+// Glyphs are rasterized this many times larger than their point size,
+// about the pixel size they end up on screen at the default zoom
+const int TEXT_OVERSAMPLE = 4;
 
-void Item::applyForces(float timeInstance){
-  this->forceX = 0.0f;
-  this->forceY = 0.0f;
-  applyGravity();
-  //applyNormalForce();
-  applyOtherForces();
-  applyFriction();
-  applyCollisionGround();
-  applyAcceleration();
-  applyPosition(timeInstance);
-}
-void Item::applyGravity(){
-  this->forceY -= this->mass * GRAVITY;
+TextBatch::TextBatch(){
+	if(FT_Init_FreeType(&library)){
+		cout << "Error: Could not initialise FreeType" << endl;
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
+	shelfX = 0;
+	shelfY = 0;
+	shelfHeight = 0;
+
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	std::vector<unsigned char> empty(TEXT_ATLAS_SIZE * TEXT_ATLAS_SIZE, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, &empty[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// Vertex layout: x, y, u, v, r, g, b
+	glGenVertexArrays(1, &VertexArrayID);
+	glGenBuffers(1, &VertexBuffer);
+	glBindVertexArray(VertexArrayID);
+	glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 7*sizeof(GLfloat), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 7*sizeof(GLfloat), (void*)(2*sizeof(GLfloat)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 7*sizeof(GLfloat), (void*)(4*sizeof(GLfloat)));
 }
 
-bool Item::checkCollisionGround(){
-  return (y - BOTTOM_BOUND <= radius);
+TextBatch::~TextBatch(){
+	glDeleteTextures(1, &textureID);
+	glDeleteBuffers(1, &VertexBuffer);
+	glDeleteVertexArrays(1, &VertexArrayID);
+	FT_Done_FreeType(library);
 }
 
-void Item::applyOtherForces(){
-  //To be implemented by other inherited classes
-}
-void Item::applyNormalForce(){
-  if(checkCollisionGround()){
-    this->forceY += this->mass * GRAVITY;
-  }
+/* Shelf packing: glyphs fill a row left to right, a new row starts
+ * under the tallest glyph of the last one. A one pixel gap keeps
+ * linear filtering from bleeding between neighbours. */
+bool TextBatch::addGlyph(int width, int height, const unsigned char* pixels, int &atlasX, int &atlasY){
+	if(shelfX + width + 1 > TEXT_ATLAS_SIZE){
+		shelfY += shelfHeight + 1;
+		shelfX = 0;
+		shelfHeight = 0;
+	}
+	if(shelfY + height + 1 > TEXT_ATLAS_SIZE || width + 1 > TEXT_ATLAS_SIZE)
+		return false;
+	atlasX = shelfX;
+	atlasY = shelfY;
+	shelfX += width + 1;
+	shelfHeight = max(shelfHeight, height);
+	if(width > 0 && height > 0){
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, atlasX, atlasY, width, height, GL_RED, GL_UNSIGNED_BYTE, pixels);
+	}
+	return true;
+}
+
+/* quads are in points around the label's origin. FTGL text used to
+ * come out at half its point size in world units, the old shader's
+ * pen added a second w, and that is kept so layouts do not move. */
+void TextBatch::add(std::vector<GLfloat> &quads, float x, float y, float scale, glm::vec3 &color){
+	float s = 0.5f * scale;
+	for(int i = 0; i + 3 < quads.size(); i += 4){
+		vertices.push_back(x + quads[i] * s);
+		vertices.push_back(y + quads[i + 1] * s);
+		vertices.push_back(quads[i + 2]);
+		vertices.push_back(quads[i + 3]);
+		vertices.push_back(color[0]);
+		vertices.push_back(color[1]);
+		vertices.push_back(color[2]);
+	}
 }
 
-void Item::applyFriction(){
-  if(checkCollisionGround()){
-    float direction;
-    if(ux > 0){
-      direction = -1.0f;
-    }
-    else direction = 1.0f;
-    this->forceX += direction * this->mass * GRAVITY  * FRICTION_COF;
-  }
+void TextBatch::flush(){
+	if(vertices.empty())
+		return;
+	glUseProgram(fontProgramID);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glUniform1i(glGetUniformLocation(fontProgramID, "glyphAtlas"), 0);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	GLsizeiptr bytes = vertices.size()*sizeof(GLfloat);
+	glBindVertexArray(VertexArrayID);
+	glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &vertices[0]);
+	glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 7);
+	vertices.clear();
 }
 
-void Item::applyCollisionGround(){
-  if(checkCollisionGround()){
-    //cout<<"Speed on collision uy = "<<uy<<endl;
-    if(uy < -20.5f){
-      uy = -1.0f * uy * BOUNCE_COF;
-      //cout<<"Speed y here = "<<uy<<endl;
-      y += radius + 0.01f; 
-      //cout<<"y here = "<<y<<endl;
-    }
-    else{
-      //cout<<"BAD LUCK"<<endl;
-      uy = 0.0f;
-      y = BOTTOM_BOUND + radius;
-    }
-
-  }
+int TextBatch::getAtlasSize(){
+	return TEXT_ATLAS_SIZE;
 }
 
-void Item::setTime(float time){
-  this->time = time;
+FT_Library TextBatch::getLibrary(){
+	return library;
 }
 
-void Item::applyAcceleration(){
-  this->ax = this->forceX / this->mass;
-  this->ay = this->forceY / this->mass;
+/* face stays owned by the caller, only its size is changed */
+/* CPU half of a FontFace, safe on any thread as long as the face is
+ * only used by one at a time */
+void rasterizeGlyphs(FT_Face face, float size, GlyphSet &glyphSet)
+{
+	FT_Set_Pixel_Sizes(face, 0, (FT_UInt)(size * TEXT_OVERSAMPLE));
+	glyphSet.family = face->family_name != NULL ? face->family_name : "";
+	for(int c = 0; c < 95; c++){
+		GlyphSet::Bitmap &b = glyphSet.glyphs[c];
+		b.loaded = !FT_Load_Char(face, c + 32, FT_LOAD_RENDER);
+		if(!b.loaded)
+			continue;
+		FT_GlyphSlot slot = face->glyph;
+		b.width = slot->bitmap.width;
+		b.rows = slot->bitmap.rows;
+		b.left = slot->bitmap_left;
+		b.top = slot->bitmap_top;
+		b.advance = slot->advance.x / 64.0f;
+		b.pixels.resize(b.width * b.rows);
+		for(int row = 0; row < b.rows; row++)
+			memcpy(&b.pixels[row * b.width], slot->bitmap.buffer + row * slot->bitmap.pitch, b.width);
+	}
 }
 
-void Item::applyPosition(float timeInstance){
-  time += timeInstance;
-  prevX = x;
-  prevY = y;
-  x = x + ux * timeInstance + (0.5 * ax * timeInstance * timeInstance);
-  y = y + uy * timeInstance + (0.5 * ay * timeInstance * timeInstance);
-  ux = ux + ax * timeInstance;
-  uy = uy + ay * timeInstance;
-  //cout<<"Speed X -> "<<ux<<" Speed Y -> "<<uy<<endl;
-  //cout<<"applyPosition speed Y -> "<<uy;
-  //cout<<" applyPosition Y -> "<<y<<endl;
-}
-
-float Item::getPositionX(){
-  return x;
+/* Opens a font from the pack in place, or from the loose file */
+FT_Error openFontFace(FT_Library library, const char* fontfile, FT_Face *face)
+{
+	// the mapping outlives the face
+	const AssetEntry *entry = assets->isOpen() ? assets->find(fontfile) : NULL;
+	if(entry != NULL && entry->type == ASSET_RAW)
+		return FT_New_Memory_Face(library, assets->getData(entry), entry->size, 0, face);
+	return FT_New_Face(library, fontfile, 0, face);
+}
+
+AssetLoader::AssetLoader(){
+}
+
+AssetLoader::~AssetLoader(){
+	for(int i = 0; i < workers.size(); i++)
+		workers[i].join();
+	for(std::map<std::string, TextureData*>::iterator it = textures.begin(); it != textures.end(); ++it)
+		delete it->second;
+	for(std::map<std::pair<std::string, float>, GlyphSet*>::iterator it = fonts.begin(); it != fonts.end(); ++it)
+		delete it->second;
+}
+
+void AssetLoader::requestTexture(const char* filename){
+	if(!textureRequests.insert(filename).second)
+		return;
+	Job job;
+	job.file = filename;
+	job.isFont = false;
+	jobs.push_back(job);
+}
+
+/* Sizes are rasterized in the order they are asked for */
+void AssetLoader::requestFont(const char* fontfile, float size){
+	if(!fontRequests.insert(std::make_pair(std::string(fontfile), size)).second)
+		return;
+	for(int i = 0; i < jobs.size(); i++)
+		if(jobs[i].isFont && jobs[i].file == fontfile){
+			jobs[i].sizes.push_back(size);
+			return;
+		}
+	Job job;
+	job.file = fontfile;
+	job.isFont = true;
+	job.sizes.push_back(size);
+	jobs.push_back(job);
+}
+
+void AssetLoader::start(int threads){
+	int count = min(max(threads, 1), (int)jobs.size());
+	for(int i = 0; i < count; i++)
+		workers.push_back(std::thread(&AssetLoader::work, this));
+}
+
+void AssetLoader::work(){
+	PROFILE_THREAD("asset loader");
+	while(true){
+		Job job;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if(jobs.empty())
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		if(job.isFont){
+			runFont(job);
+			continue;
+		}
+		TextureData *data = new TextureData();
+		{
+			PROFILE_ZONE("decodeTexture");
+			decodeTexture(job.file.c_str(), *data);
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		textures[job.file] = data;
+		finished.notify_all();
+	}
 }
 
-float Item::getPositionY(){
-  return y;
+/* A library of its own, FreeType objects must not be shared between
+ * threads. Each size is handed over as soon as it is done. */
+void AssetLoader::runFont(Job &job){
+	FT_Library library;
+	FT_Face face;
+	bool opened = !FT_Init_FreeType(&library);
+	opened = opened && !openFontFace(library, job.file.c_str(), &face);
+	for(int i = 0; i < job.sizes.size(); i++){
+		GlyphSet *glyphSet = NULL;
+		if(opened){
+			PROFILE_ZONE("rasterizeGlyphs");
+			glyphSet = new GlyphSet();
+			rasterizeGlyphs(face, job.sizes[i], *glyphSet);
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		fonts[std::make_pair(job.file, job.sizes[i])] = glyphSet;
+		finished.notify_all();
+	}
+	if(opened)
+		FT_Done_Face(face);
+	FT_Done_FreeType(library);
+}
+
+TextureData* AssetLoader::texture(const char* filename){
+	std::unique_lock<std::mutex> guard(lock);
+	if(textureRequests.erase(filename) == 0)
+		return NULL;
+	std::map<std::string, TextureData*>::iterator found;
+	while((found = textures.find(filename)) == textures.end())
+		finished.wait(guard);
+	TextureData *data = found->second;
+	textures.erase(found);
+	return data;
+}
+
+/* NULL for a font that could not be opened too, the caller reports it */
+GlyphSet* AssetLoader::font(const char* fontfile, float size){
+	std::pair<std::string, float> key(fontfile, size);
+	std::unique_lock<std::mutex> guard(lock);
+	if(fontRequests.erase(key) == 0)
+		return NULL;
+	std::map<std::pair<std::string, float>, GlyphSet*>::iterator found;
+	while((found = fonts.find(key)) == fonts.end())
+		finished.wait(guard);
+	GlyphSet *glyphSet = found->second;
+	fonts.erase(found);
+	return glyphSet;
+}
+
+/* Packs the glyphs into the batch's atlas */
+FontFace::FontFace(TextBatch *batch, const GlyphSet &glyphSet)
+{
+	float texel = 1.0f / batch->getAtlasSize();
+	float point = 1.0f / TEXT_OVERSAMPLE;
+	for(int c = 0; c < 95; c++){
+		Glyph &g = glyphs[c];
+		const GlyphSet::Bitmap &b = glyphSet.glyphs[c];
+		memset(&g, 0, sizeof(Glyph));
+		if(!b.loaded)
+			continue;
+		g.advance = b.advance * point;
+		int atlasX, atlasY;
+		if(!batch->addGlyph(b.width, b.rows, b.pixels.empty() ? NULL : &b.pixels[0], atlasX, atlasY)){
+			cout << "Glyph atlas is full, `" << (char)(c + 32) << "' of " << glyphSet.family << " is left out" << endl;
+			continue;
+		}
+		g.x0 = b.left * point;
+		g.x1 = (b.left + b.width) * point;
+		g.y1 = b.top * point;
+		g.y0 = (b.top - b.rows) * point;
+		g.u0 = atlasX * texel;
+		g.u1 = (atlasX + b.width) * texel;
+		g.v0 = (atlasY + b.rows) * texel; // bottom of the glyph
+		g.v1 = atlasY * texel;
+	}
 }
 
-bool Item::checkStoppage(){
-  float tx = x - prevX;
-  float ty = y - prevY;
-  if(tx < 0.0f)tx *= -1.0f;
-  if(ty < 0.0f)ty *= -1.0f;
-  if(tx < 0.01f && ty < 0.01f)
-    {
-      cout<<"returned TRUE"<<endl;
-      return true;
-    }
-  else return false;
+/* Replaces quads with two triangles per visible glyph, as x, y, u, v
+ * in points from the start of the baseline. A tab advances like a space. */
+void FontFace::layout(const char* word, std::vector<GLfloat> &quads)
+{
+	quads.clear();
+	float pen = 0.0f;
+	for(const char *p = word; *p != '\0'; p++){
+		int c = (unsigned char)*p;
+		if(c == '\t')
+			c = ' ';
+		if(c < 32 || c > 126)
+			continue;
+		Glyph &g = glyphs[c - 32];
+		if(g.x1 > g.x0){
+			float corners[6][4] = {
+				{g.x0, g.y0, g.u0, g.v0}, {g.x1, g.y0, g.u1, g.v0}, {g.x1, g.y1, g.u1, g.v1},
+				{g.x0, g.y0, g.u0, g.v0}, {g.x1, g.y1, g.u1, g.v1}, {g.x0, g.y1, g.u0, g.v1}
+			};
+			for(int k = 0; k < 6; k++){
+				quads.push_back(pen + corners[k][0]);
+				quads.push_back(corners[k][1]);
+				quads.push_back(corners[k][2]);
+				quads.push_back(corners[k][3]);
+			}
+		}
+		pen += g.advance;
+	}
 }
 
-void Item::setPosition(float x, float y){
-  this->x = x;
-  this->y = y;
+FontCache::FontCache(TextBatch *batch){
+	this->batch = batch;
 }
 
-void Item::setSpeed(float ux, float uy){
-  this->ux = ux;
-  this->uy = uy;
+FontCache::~FontCache(){
+	for(std::map<std::pair<std::string, float>, CachedFace>::iterator it = faces.begin(); it != faces.end(); ++it)
+		delete it->second.font;
+	for(std::map<std::string, FontFile>::iterator it = files.begin(); it != files.end(); ++it)
+		FT_Done_Face(it->second.face);
 }
 
-Block::Block(GLMatrices *mtx, int x, int y, int width, int height, bool dynamic){
-  float *colorBlock = new float[3];
-  colorBlock[0] = 0.6;
-  colorBlock[1] = 0.298;
-  colorBlock[2] = 0.0f;
-  rect = new Rectangle(mtx,colorBlock,x, y, width, height, 0);
-  this->dynamic = dynamic;
-  this->time = 0.0f;
-  if(dynamic){
-  	//cout<<" Is dynamic "<<endl;
-  	this->leftBound = x - 10.0f;
-  	this->rightBound = x + 10.0f;
-  	this->speed = 5.0f;
-  	//cout<<"left bound -> "<<leftBound<<" Right Bound -> "<<rightBound<<endl;
-  }
-  else{
-  	this->leftBound = x;
-  	this->rightBound = x;
-  	this->speed = 0.0f;
-  }
-}
-
-void Block::draw(){
-  rect->draw();
-}
+FontFace* FontCache::acquire(const char* fontfile, float size){
+	std::pair<std::string, float> key(fontfile, size);
+	std::map<std::pair<std::string, float>, CachedFace>::iterator found = faces.find(key);
+	if(found != faces.end()){
+		found->second.refs++;
+		return found->second.font;
+	}
 
-float Block::getPositionY(){
-  return rect->getTopLeftY();
-}
-float Block::getPositionX(){
-  return rect->getTopLeftX();
-}
-float Block::getHeight(){
-  return rect->getHeight();
-}
-float Block::getWidth(){
-  return rect->getWidth();
-}
+	CachedFace cached;
+	cached.fontfile = key.first;
+	cached.refs = 1;
+	GlyphSet *glyphSet = loader != NULL ? loader->font(fontfile, size) : NULL;
+	cached.ownsFile = glyphSet == NULL;
+	if(cached.ownsFile){
+		std::map<std::string, FontFile>::iterator file = files.find(key.first);
+		if(file == files.end()){
+			FontFile loaded;
+			if(openFontFace(batch->getLibrary(), fontfile, &loaded.face))
+			{
+				cout << "Error: Could not load font `" << fontfile << "'" << endl;
+				glfwTerminate();
+				exit(EXIT_FAILURE);
+			}
+			loaded.sizes = 0;
+			file = files.insert(std::make_pair(key.first, loaded)).first;
+		}
+		file->second.sizes++;
+		glyphSet = new GlyphSet();
+		rasterizeGlyphs(file->second.face, size, *glyphSet);
+	}
 
-void Block::applyForces(float timeInstance){
-	float tx;
-	if(dynamic){
-		time += timeInstance;
-		tx = getPositionX();
-		tx += speed* timeInstance;
-		rect->setTopLeftX(tx);
-		if(tx < leftBound || tx > rightBound){
-			speed *= -1.0f;
+	cached.font = new FontFace(batch, *glyphSet);
+	delete glyphSet;
+	faces[key] = cached;
+	return cached.font;
+}
+
+void FontCache::release(FontFace* font){
+	for(std::map<std::pair<std::string, float>, CachedFace>::iterator it = faces.begin(); it != faces.end(); ++it){
+		if(it->second.font != font)
+			continue;
+		if(--it->second.refs > 0)
+			return;
+		std::map<std::string, FontFile>::iterator file = files.find(it->second.fontfile);
+		if(it->second.ownsFile && --file->second.sizes == 0){
+			FT_Done_Face(file->second.face);
+			files.erase(file);
 		}
-		//cout<<"Force applied, tx = "<<tx<<endl;
+		delete it->second.font;
+		faces.erase(it);
+		return;
 	}
 }
 
-bool Block::isDynamic(){
-	return dynamic;
+int FontCache::getFaceCount(){
+	return faces.size();
 }
 
-float Block::getSpeed(){
-	return speed;
+int FontCache::getFileCount(){
+	return files.size();
 }
 
-float Block::getLeftBound(){
-	return leftBound;
+TextLabel::TextLabel(GLMatrices *mtx, float* color, char* fontfile, char* word,float size, float x, float y, float scaleFactor)
+{
+	this->mtx = mtx;
+	fontColor = glm::vec3(color[0], color[1], color[2]);
+	this->word = new char[100];
+	strcpy(this->word, word);
+	this->x = x;
+	this->y = y;
+	this->scaleFactor = scaleFactor;
+	this->font = fontCache->acquire(fontfile, size);
+	this->font->layout(this->word, quads);
 }
 
-float Block::getRightBound(){
-	return rightBound;
+TextLabel::~TextLabel(){
+	fontCache->release(font);
+	delete[] word;
 }
 
-Target::Target(GLMatrices *mtx, Block* pillar)
-  :Item(3.0f, pillar->getPositionX(), pillar->getPositionY() + pillar->getHeight()/2.0f + 2.5f, pillar->getSpeed(), 0.0f, 2.5f)
-{
-  float *colorTarget = new float[3];
-  colorTarget[0] = 0.4f;
-  colorTarget[1] = 0.0f;
-  colorTarget[2] = 0.4f;
-  float ty = pillar->getPositionY() + pillar->getHeight()/2.0f + radius;
-  circ = new Circle(mtx, colorTarget, getPositionX(), ty, radius, 100);
-  this->pillar = pillar;
-  this->collisionFlag = false;
+void TextLabel::setScaleFactor(float scaleFactor){
+	this->scaleFactor = scaleFactor;
 }
 
-void Target::draw(){
-  circ->draw();
+float TextLabel::getScaleFactor(){
+	return scaleFactor;
 }
 
-void Target::applyForces(float timeInstance){
-  Item::applyForces(timeInstance);
-  float tx = getPositionX();
-  float ty = getPositionY();
-  if(pillar->isDynamic() && isInContact()){
-  	if(tx < pillar->getLeftBound() || tx > pillar->getRightBound()){
-  			this->ux *= -1.0f;
-  		}
-  	}
-  circ->setCenter(tx,ty);
+/* Queued, the text reaches the screen when textBatch is flushed */
+void TextLabel::draw(){
+	textBatch->add(quads, x, y, scaleFactor, fontColor);
 }
 
-bool Target::isInContact(){
-  float lb = pillar->getPositionX() - pillar->getWidth()/2.0f;
-  float rb = pillar->getPositionX() + pillar->getWidth()/2.0f;
-  float ub = pillar->getPositionY() + pillar->getHeight()/2.0f + circ->getRadius() + 1.0f;
-  if(this->x >= lb && this->x <=rb && this->y <= ub)
-  	return true;
-  else return false;
+void TextLabel::setWord(char* word){
+	if(strcmp(this->word, word) == 0)
+		return;
+	strcpy(this->word, word);
+	font->layout(this->word, quads);
 }
 
-void Target::applyOtherForces(){
-  if(isInContact()){
-    	this->forceY += this->mass * GRAVITY;
-	}
+/* Writes value in decimal to out, which needs room for 12 chars, and
+ * returns the length. No allocation and no printf, the HUD calls it
+ * from the physics tick. */
+int formatInt(int value, char *out)
+{
+	char digits[12];
+	int count = 0;
+	unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+	do{
+		digits[count++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	}while(magnitude > 0);
+	int length = 0;
+	if(value < 0)
+		out[length++] = '-';
+	while(count > 0)
+		out[length++] = digits[--count];
+	out[length] = '\0';
+	return length;
+}
+
+HudField::HudField(TextLabel *label, const char *name)
+{
+	this->label = label;
+	nameLength = strlen(name);
+	strcpy(text, name);
+	value = 0;
+	formatted = false;
 }
 
-FTGLFont::FTGLFont(GLMatrices *mtx, float* color, char* fontfile, char* word,float size, float x, float y, float scaleFactor)
+HudField::~HudField()
 {
-	cout<<"Entered ftgl"<<endl;
-	this->mtx = mtx;
-	cout<<"mtx made"<<endl;
-	fontColor = glm::vec3(color[0], color[1], color[2]);
-	cout<<"vec color made"<<endl;
-	this->fontfile = new char[20];
-	strcpy(this->fontfile, fontfile);
-	this->word = new char[100];
-	strcpy(this->word, word);
-	cout<<"str copied"<<endl;
-	this->x = x;
-	this->y = y;
-	this->scaleFactor = scaleFactor;
-	
-	cout<<" Above this->font"<<endl;
-	this->font = new FTExtrudeFont(fontfile); // 3D extrude style rendering
-	if(this->font->Error())
-	{
-		cout << "Error: Could not load font `" << fontfile << "'" << endl;
-		glfwTerminate();
-		exit(EXIT_FAILURE);
-	}
-
-	// Create and compile our GLSL program from the font shaders
-	
-	this->fontMatrixID = glGetUniformLocation(fontProgramID, "MVP");
-	this->fontColorID = glGetUniformLocation(fontProgramID, "fontColor");
+	delete label;
+}
 
-	this->font->ShaderLocations(fontVertexCoordAttrib, fontVertexNormalAttrib, fontVertexOffsetUniform);
-	this->font->FaceSize(size);
-	this->font->Depth(0);
-	this->font->Outset(0, 0);
-	this->font->CharMap(ft_encoding_unicode);
+void HudField::setValue(int value)
+{
+	if(formatted && value == this->value)
+		return;
+	this->value = value;
+	formatted = true;
+	formatInt(value, text + nameLength);
+	label->setWord(text);
 }
 
-void FTGLFont::setScaleFactor(float scaleFactor){
-	this->scaleFactor = scaleFactor;
+void HudField::draw()
+{
+	label->draw();
 }
 
-float FTGLFont::getScaleFactor(){
-	return scaleFactor;
+Hud::Hud(GLMatrices *mtx, float* color, char* fontfile, float size, float x, float y, float lineGap)
+{
+	char speedName[] = "Speed:";
+	char shotsName[] = "Shots:";
+	char scoreName[] = "Score:";
+	speed = new HudField(new TextLabel(mtx, color, fontfile, speedName, size, x, y, 1.0f), speedName);
+	shots = new HudField(new TextLabel(mtx, color, fontfile, shotsName, size, x, y - lineGap, 1.0f), shotsName);
+	score = new HudField(new TextLabel(mtx, color, fontfile, scoreName, size, x, y - 2.0f * lineGap, 1.0f), scoreName);
 }
 
-void FTGLFont::draw(){
-  glm::mat4 MVP;
-  Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
-	// Transform the text
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translateText = glm::translate(glm::vec3(x,y,0));
-	glm::mat4 scaleText = glm::scale(glm::vec3(scaleFactor,scaleFactor,scaleFactor));
-	Matrices.model *= (translateText * scaleText);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(this->fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(this->fontColorID, 1, &fontColor[0]); 
+Hud::~Hud()
+{
+	delete speed;
+	delete shots;
+	delete score;
+}
 
-	// Render font
-	this->font->Render(word);
+void Hud::update(int speed, int shots, int score)
+{
+	this->speed->setValue(speed);
+	this->shots->setValue(shots);
+	this->score->setValue(score);
 }
 
-void FTGLFont::setWord(char* word){
-	strcpy(this->word, word);
+void Hud::draw()
+{
+	speed->draw();
+	shots->draw();
+	score->draw();
 }
 
 float camera_position = 0.0f;
@@ -1465,6 +2204,7 @@ void zoomIn(){
   TOP_BOUND -= ZOOM_FACTOR;
   BOTTOM_BOUND += ZOOM_FACTOR;
   Matrices.projection = glm::ortho(LEFT_BOUND, RIGHT_BOUND, BOTTOM_BOUND, TOP_BOUND, 0.1f, 500.0f);
+  simulation->send(INPUT_BOUNDS, LEFT_BOUND, RIGHT_BOUND, TOP_BOUND, BOTTOM_BOUND);
 }
 
 void zoomOut(){
@@ -1473,189 +2213,10 @@ void zoomOut(){
   TOP_BOUND += ZOOM_FACTOR;
   BOTTOM_BOUND -= ZOOM_FACTOR;
   Matrices.projection = glm::ortho(LEFT_BOUND, RIGHT_BOUND, BOTTOM_BOUND, TOP_BOUND, 0.1f, 500.0f);
+  simulation->send(INPUT_BOUNDS, LEFT_BOUND, RIGHT_BOUND, TOP_BOUND, BOTTOM_BOUND);
 }
 
 
-bool checkCollisionItem(Item &first, Item &second, bool &flag){
-  float x12 = first.x - second.x;
-  float y12 = first.y - second.y;
-  float dist = x12*x12 + y12*y12 - 5.0f;
-  float r12 = first.radius + second.radius;
-  r12 = r12 * r12;
-  if(dist <= r12 && flag)
-    {
-      //cout<<"*******COLLISION HAPPENED***********"<<endl;
-      flag = false;
-      return true;
-    }
-  else
-    {
-      //cout<<"####### NO COLLISION ####"<<endl;
-      return false;
-    }
-
-}
-
-void simulateCollisionItem(Item &first, Item &second){
-
-  //Vector pointing in direction of collision
-  float cx = first.x - second.x;
-  float cy = first.y - second.y;
-
-  //Distance of the above vector
-  float distance = (float)sqrt(cx*cx + cy*cy);
-
-  //Unit vector in direction of collision
-  float unitX, unitY;
-  if(distance == 0.0f){
-    unitX = 1.0f;
-    unitY = 0.0f;
-  }
-  else{
-    unitX = cx/distance;
-    unitY = cy/distance;
-  }
-
-  // Component of velocity of Item first,second in 
-  // in direction of collision
-  float firstInitComp = first.ux * unitX + first.uy * unitY;
-  float secondInitComp = second.ux * unitX + second.uy * unitY;
-
-  float firstFinalComp = (firstInitComp*(first.mass - second.mass) + 2*second.mass*secondInitComp)/(first.mass + second.mass);
-  float secondFinalComp = (secondInitComp*(second.mass - first.mass) + 2*first.mass*firstInitComp)/(first.mass + second.mass);
-
-  float firstChange = firstFinalComp - firstInitComp;
-  float secondChange = secondFinalComp - secondInitComp;
-
-  first.ux += firstChange * unitX;
-  first.uy += firstChange * unitY;
-
-  second.ux += secondChange * unitX;
-  second.uy += secondChange * unitY;
-
-  float magFirstChangeX = (firstChange * unitX) > 0.0f ? (firstChange * unitX) : (-1.0f * firstChange * unitX);
-  float magFirstChangeY = (firstChange * unitY) > 0.0f ? (firstChange * unitY) : (-1.0f * firstChange * unitY);
-  
-  float magSecondChangeX = (secondChange * unitX) > 0.0f ? (secondChange * unitX) : (-1.0f * secondChange * unitX);
-  float magSecondChangeY = (secondChange * unitY) > 0.0f ? (secondChange * unitY) : (-1.0f * secondChange * unitY);
-
-  if(true){
-  	first.x += (firstChange * unitX)/magFirstChangeX * 1.0f;
-  	first.y += (firstChange * unitY)/magSecondChangeX * 1.0f;
-  	second.x += (secondChange * unitX)/magSecondChangeX * 1.0f;
-  	second.y += (secondChange * unitY)/magSecondChangeY * 1.0f;
-  }
-
-  //cout<<" Change First Ux = "<< firstChange * unitX<<endl;
-  //cout<<" Change First Uy = "<< firstChange * unitY<<endl;
-
-  //cout<<" Change Second Ux = "<< secondChange * unitX<<endl;
-  //cout<<" Change Second Uy = "<< secondChange * unitY<<endl;
-
-}
-
-void handleCollisionsItem(){
-  //cout<<"Movable list size "<<movableList.size()<<endl;
-  bool flag = true;
-  for(int i = 0; i < movableList.size(); i++){
-    for(int j = i + 1; j < movableList.size(); j++){
-      flag = true;
-      if(checkCollisionItem(*movableList[i], *movableList[j], flag)){
-      	if(movableList[i]->collisionFlag == false){
-      		movableList[i]->collisionFlag = true;
-      		gameScore++;
-      	}
-      	if(movableList[j]->collisionFlag == false){
-      		movableList[j]->collisionFlag = true;
-      		gameScore++;
-      	}
-      	simulateCollisionItem(*movableList[i], *movableList[j]);
-      }
-    }
-  }
-
-}
-
-bool checkCollisionBlock(Item& ball, Block& obs)
-{
-  float obsLeftBound = obs.rect->getTopLeftX() - obs.rect->getWidth()/2.0f - ball.radius;
-  float obsRightBound = obs.rect->getTopLeftX() + obs.rect->getWidth()/2.0f + ball.radius;
-  float obsTopBound = obs.rect->getTopLeftY() + obs.rect->getHeight()/2.0f + ball.radius;
-  float obsBottomBound = obs.rect->getTopLeftY() - obs.rect->getHeight()/2.0f - ball.radius;
-  if(ball.x > obsLeftBound && ball.x < obsRightBound && ball.y < obsTopBound && ball.y > obsBottomBound){
-    return true;
-  }
-  else return false;
-}
-
-void simulateCollisionBlock(Item& ball, Block &obs){
-  float obsLeftBound = obs.rect->getTopLeftX() - obs.rect->getWidth()/2.0f - ball.radius;
-  float obsRightBound = obs.rect->getTopLeftX() + obs.rect->getWidth()/2.0f + ball.radius;
-  float obsTopBound = obs.rect->getTopLeftY() + obs.rect->getHeight()/2.0f + ball.radius;
-  float obsBottomBound = obs.rect->getTopLeftY() - obs.rect->getHeight()/2.0f - ball.radius;
-  float obsTop = obs.rect->getTopLeftY() + obs.rect->getHeight()/2.0f;
-  float obsBottom = obs.rect->getTopLeftY() - obs.rect->getHeight()/2.0f;
-  if(ball.y < obsTop && ball.y > obsBottom){
-    ball.ux = -1.0f * Item::OBS_BOUNCE_COF * ball.ux;
-    if(ball.x < obs.rect->getTopLeftX())
-      ball.x = obsLeftBound - 1.0f;
-    else
-      ball.x = obsRightBound + 1.0f;
-
-  }
-  else {
-  	ball.uy = -1.0f * Item::OBS_BOUNCE_COF * ball.uy;
-  	if(ball.y > obs.rect->getTopLeftY())
-  		ball.y = obsTopBound + 1.0f;
-  	else
-  		ball.y = obsBottomBound - 1.0f;
-  }
-}
-
-void handleCollisionsBlock(){
-  for(int i = 0; i < movableList.size(); i++){
-    for(int j = 0; j < obstacleList.size(); j++){
-      if(checkCollisionBlock(*movableList[i], *obstacleList[j]))
-        simulateCollisionBlock(*movableList[i], *obstacleList[j]);
-    }
-  }
-}
-
-bool checkCollisionWall(Item& ball){
-	float ballRightSide = ball.x + ball.radius;
-	float ballLeftSide = ball.x - ball.radius;
-	float ballTopSide = ball.y + ball.radius;
-	if(ballRightSide > RIGHT_BOUND || ballLeftSide < LEFT_BOUND || ballTopSide > TOP_BOUND){
-		return true;
-	}
-	else return false;
-}
-
-void simulateCollisionWall(Item& ball){
-	float ballRightSide = ball.x + ball.radius;
-	float ballLeftSide = ball.x - ball.radius;
-	float ballTopSide = ball.y + ball.radius;
-	if(ballRightSide > RIGHT_BOUND || ballLeftSide < LEFT_BOUND){
-		ball.ux = -1.0f * Item::WALL_BOUNCE_COF * ball.ux;
-		if(ballRightSide > RIGHT_BOUND)
-			ball.x -= (ball.radius + 0.01f);
-		if(ballLeftSide < LEFT_BOUND)
-			ball.x += (ball.radius + 0.01f);
-	}
-	if(ballTopSide > TOP_BOUND){
-		ball.uy = -1.0f * Item::WALL_BOUNCE_COF * ball.uy;
-		ball.y -= (ball.radius + 0.01f);
-	}
-}
-
-void handleCollisionsWall(){
-	for(int i = 0; i < movableList.size(); i++){
-		if(checkCollisionWall(*movableList[i])){
-			simulateCollisionWall(*movableList[i]);
-		}
-	}
-}
-
 /* Executed when a regular key is pressed/released/held-down */
 /* Prefered for Keyboard events */
 void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -1672,7 +2233,7 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
                 triangle_rot_status = !triangle_rot_status;
                 break;
             case GLFW_KEY_X:
-                // do something ..
+                exportTrace();
                 break;
             default:
                 break;
@@ -1681,16 +2242,16 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
     else if (action == GLFW_PRESS) {
         switch (key) {
             case GLFW_KEY_A:
-                can->barrelUp();
+                simulation->send(INPUT_BARREL_UP);
                 break;
             case GLFW_KEY_B:
-                can->barrelDown();
+                simulation->send(INPUT_BARREL_DOWN);
                 break;
             case GLFW_KEY_F:
-                can->increaseSpeed();
+                simulation->send(INPUT_SPEED_UP);
                 break;
             case GLFW_KEY_S:
-                can->decreaseSpeed();
+                simulation->send(INPUT_SPEED_DOWN);
                 break;
             case GLFW_KEY_LEFT:
                 panCameraLeft();
@@ -1705,7 +2266,7 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
                 zoomOut();
                 break;
             case GLFW_KEY_SPACE:
-                can->shoot();
+                simulation->send(INPUT_SHOOT);
                 break;
             case GLFW_KEY_ESCAPE:
                 quit(window);
@@ -1713,6 +2274,24 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
             case GLFW_KEY_ENTER:
                 gameSplash = true;
                 break;
+            case GLFW_KEY_K:
+                simulation->send(INPUT_CHECKPOINT);
+                break;
+            case GLFW_KEY_R:
+                simulation->send(INPUT_ROLLBACK);
+                break;
+            default:
+                break;
+        }
+    }
+    else if (action == GLFW_REPEAT) {
+        switch (key) {
+            case GLFW_KEY_SPACE:
+                // holding space keeps firing in salvo mode, which is
+                // only ever set before the simulation starts
+                if(can->getSalvo())
+                    simulation->send(INPUT_SHOOT);
+                break;
             default:
                 break;
         }
@@ -1752,11 +2331,12 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 					result = atan(ypos/xpos) * 180 / M_PI;
 					result = -1.0f * (90.0f - result);
 					cout<<"Angle is "<<result<<endl;
-					can->setBarrelAngle((float)result);
-					if(xpos < window_width/4)can->setBombInitSpeed(80.0f);
-					else if(xpos >= window_width/4 && xpos < window_width/2)can->setBombInitSpeed(100.0f);
-					else if(xpos >= window_width/2 && xpos < window_width*3/4.0f)can->setBombInitSpeed(110.0f);
-					else can->setBombInitSpeed(130.0f);
+					float speed;
+					if(xpos < window_width/4)speed = 80.0f;
+					else if(xpos >= window_width/4 && xpos < window_width/2)speed = 100.0f;
+					else if(xpos >= window_width/2 && xpos < window_width*3/4.0f)speed = 110.0f;
+					else speed = 130.0f;
+					simulation->send(INPUT_AIM, (float)result, speed);
                 }
             //else if(action == GLFW_RELEASE)
             break;
@@ -1811,7 +2391,8 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
     int fbwidth=width, fbheight=height;
     /* With Retina display on Mac OS X, GLFW's FramebufferSize
      is different from WindowSize */
-    glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+    if(window != NULL)
+        glfwGetFramebufferSize(window, &fbwidth, &fbheight);
 
 	GLfloat fov = 90.0f;
 
@@ -1832,79 +2413,70 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
 
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
-void draw()
+/* alpha blends moving objects between the last two physics steps.
+ * snapshot is NULL until the game is loaded, for the splash screen. */
+void draw(WorldSnapshot *snapshot, float alpha)
 {
+  PROFILE_ZONE("draw");
   // clear the color and depth in the frame buffer
   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+  // Compute Camera matrix (view)
+  // Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
+  //  Don't change unless you are sure!!
+  Matrices.view = glm::lookAt(glm::vec3(camera_position,0,3), glm::vec3(camera_position,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+  updateFrameUniforms();
+
   // Render with texture shaders now
   glUseProgram(textureProgramID);
   background->draw();
   // use the loaded shader program
   // Don't change unless you know what you are doing
   glUseProgram (programID);
-  // Compute Camera matrix (view)
-  // Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
-  //  Don't change unless you are sure!!
-  Matrices.view = glm::lookAt(glm::vec3(camera_position,0,3), glm::vec3(camera_position,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
 
   //static float c = 0;
 	//c++;
 	//Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(sinf(c*M_PI/180.0),3*cosf(c*M_PI/180.0),0)); // Fixed camera for 2D (ortho) in XY plane
-  // Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
-  //  Don't change unless you are sure!!
-  glm::mat4 VP = Matrices.projection * Matrices.view;
-
-  // Send our transformation to the currently bound shader, in the "MVP" uniform
-  // For each model you render, since the MVP will be different (at least the M part)
-  //  Don't change unless you are sure!!
-  glm::mat4 MVP;	// MVP = Projection * View * Model
+  // View-projection for this frame is in the Frame uniform block,
+  // objects only send their own 2D placement
 
   // Load identity to model matrix
   //r->draw();
   //c->draw();
-  if(gameSplash){
-	  	 if(gameLoose == false && gameWin == false){
-	  	  can->draw();
-
-		  b1->draw();
-		  t1->draw();
-
-		  b2->draw();
-		  t2->draw();
-
-		  b3->draw();
-		  t3->draw();
-
-		  b4->draw();
-		  t4->draw();
-
-		  //b5->draw();
-		  //t5->draw();
+  if(gameSplash && snapshot != NULL){
+	  	 if(snapshot->loose == false && snapshot->win == false){
+	  	  can->draw(*snapshot, alpha);
+
+		  for(int i = 0; i < blockViews.size(); i++)
+		  	blockViews[i]->draw(snapshot->blocks[i], alpha);
+		  for(int i = 0; i < targetViews.size(); i++)
+		  	targetViews[i]->draw(snapshot->targets[i], alpha);
+		  // everything queued above goes out in one call per mesh,
+		  // rectangles first as they were drawn before the circles
+		  PROFILE_ZONE("flush shapes");
+		  rectBatch->flush();
+		  circleBatch->flush();
 	  }
 	}
 
-	glUseProgram(fontProgramID);
-
-	if(gameSplash){
-	  if(gameLoose == true){
+	if(gameSplash && snapshot != NULL){
+	  if(snapshot->loose == true){
 	  	fLoose->draw();
 	  	
 	  }
-	  if(gameWin == true){
+	  if(snapshot->win == true){
 	  	fWin->draw();
 	  }
-	  if(gameLoose == false && gameWin == false){
+	  if(snapshot->loose == false && snapshot->win == false){
+	  	// only fields whose value changed touch their text
+	  	hud->update(snapshot->speed, snapshot->shotsLeft, snapshot->score);
 	  	// Render font on screen
 		  //static int fontScale = 0;
 		  /*float fontScaleValue = 5.0f;
 		  glm::vec3 fontColor = glm::vec3(0,0,0);*/
 
-		  glUseProgram(fontProgramID);
 		  f1->draw();
-		  f2->draw();
-		  f3->draw();
-		  fScore->draw();
+		  hud->draw();
 
 	  }
   }
@@ -1923,6 +2495,12 @@ void draw()
   	fontScale = (fontScale + 1) % 360;
   }
 
+  // all the text queued above, in one draw call
+  {
+    PROFILE_ZONE("flush text");
+    textBatch->flush();
+  }
+
  
 	  
 
@@ -1982,8 +2560,40 @@ GLFWwindow* initGLFW (int width, int height)
 /* Initialize the OpenGL rendering properties */
 /* Add all the models to be created here */
 
+/* Only what the splash screen shows is loaded here, initGame() does
+ * the rest once the first frame is up. Image decoding and font
+ * rasterizing run on the loader's threads meanwhile. */
 void initGL (GLFWwindow* window, int width, int height)
 {
+	PROFILE_ZONE("initGL");
+	char fileString[20]; 
+	strcpy(fileString, "kimberly.ttf");
+
+	char fileString2[20];
+	strcpy(fileString2, "fella.ttf");
+
+	// Splash sizes first, the 40 is for the end of the game
+	loader = new AssetLoader();
+	loader->requestTexture("backpic.png");
+	loader->requestFont(fileString, 20.0f);
+	loader->requestFont(fileString, 13.0f);
+	loader->requestFont(fileString2, 13.0f);
+	loader->requestFont(fileString, 40.0f);
+	loader->start(std::thread::hardware_concurrency());
+
+	// Create and compile our GLSL program from the texture shaders
+	textureProgramID = LoadShaders( "TextureRender.vert", "TextureRender.frag" );
+	// Get a handle for our "placement" uniform
+	Matrices.TexPlacementID = glGetUniformLocation(textureProgramID, "placement");
+
+	// Initialise the text renderer
+	fontProgramID = LoadShaders( "fontrender.vert", "fontrender.frag" );
+	textBatch = new TextBatch();
+	fontCache = new FontCache(textBatch);
+
+	initFrameUniforms();
+	bindFrameUniforms(textureProgramID);
+	bindFrameUniforms(fontProgramID);
 
 	// Load Textures
 	// Enable Texture0 as current texture memory
@@ -1995,50 +2605,11 @@ void initGL (GLFWwindow* window, int width, int height)
 	if(textureID == 0 )
 		cout << "SOIL loading error: '" << SOIL_last_result() << "'" << endl;
 
-	// Create and compile our GLSL program from the texture shaders
-	textureProgramID = LoadShaders( "TextureRender.vert", "TextureRender.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.TexMatrixID = glGetUniformLocation(textureProgramID, "MVP");
-
     /* Objects should be created before any other gl function and shaders */
 //GLMatrices *mtx, GLuint textureID, float x, float y,
 // float width, float height, float angle)
 
   background = new Image(&Matrices, textureID, 0.0f, 0.0f, LEFT_BOUND * 2.0f, TOP_BOUND * 2.0f, 0.0f);
-  can = new Cannon(&Matrices);
-  b1 = new Block(&Matrices, -2, BOTTOM_BOUND + 6, 5, 12);
-  t1 = new Target(&Matrices, b1);
-
-  b2 = new Block(&Matrices, -2, 6, 5, 12, true);
-  t2 = new Target(&Matrices, b2);
-
-  b3 = new Block(&Matrices, 30, 0, 5, 12);
-  t3 = new Target(&Matrices, b3);
-
-  b4 = new Block(&Matrices, -24, BOTTOM_BOUND + 6, 5, 12, true);
-  t4 = new Target(&Matrices, b4);
-
-  //b5 = new Block(&Matrices, 35, BOTTOM_BOUND + 6, 5, 12);
-  //t5 = new Target(&Matrices, b5);
-
-  movableList.push_back(t1);
-  obstacleList.push_back(b1);
-  movableList.push_back(t2);
-  obstacleList.push_back(b2);
-  movableList.push_back(t3);
-  obstacleList.push_back(b3);
-  movableList.push_back(t4);
-  obstacleList.push_back(b4);
-  //movableList.push_back(t5);
-  //obstacleList.push_back(b5);
-	//createTriangle (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
-	//createRectangle ();
-	
-	// Create and compile our GLSL program from the shaders
-	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
-
 	
 	reshapeWindow (window, width, height);
 
@@ -2051,45 +2622,15 @@ void initGL (GLFWwindow* window, int width, int height)
 	//glEnable(GL_BLEND);
 	//glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-
-	// Initialise FTGL stuff
-	fontProgramID = LoadShaders( "fontrender.vert", "fontrender.frag" );
-
-	fontVertexCoordAttrib = glGetAttribLocation(fontProgramID, "vertexPosition");
-	fontVertexNormalAttrib = glGetAttribLocation(fontProgramID, "vertexNormal");
-	fontVertexOffsetUniform = glGetUniformLocation(fontProgramID, "pen");
-
-//FTGLFont(GLMatrices *mtx, float* color, char* fontfile, float size, float x, float y, float scaleFactor)
+//TextLabel(GLMatrices *mtx, float* color, char* fontfile, float size, float x, float y, float scaleFactor)
 	float colArrayFont[3];
 	colArrayFont[0] = 0;
 	colArrayFont[1] = 0;
 	colArrayFont[2] = 0;
 
-	char fileString[20]; 
-	strcpy(fileString, "kimberly.ttf");
-
-	char fileString2[20];
-	strcpy(fileString2, "fella.ttf");
-
-
 	char wordName[50];
 	strcpy(wordName, "The(_)Ball(_)Machine");
 
-	char wordName2[50];
-	strcpy(wordName2, "Speed:");
-
-	char wordName3[50];
-	strcpy(wordName3, "Shots:");
-
-	char wordName4[50];
-	strcpy(wordName3, "Score:");
-
-	char looseName[50];
-	strcpy(looseName, "\tYou Loose !!!\t");
-
-	char winName[50];
-	strcpy(winName, "\tYou Win !!!\t");
-
 	char enterName[50];
 	strcpy(enterName, "Press enter");
 
@@ -2105,18 +2646,12 @@ void initGL (GLFWwindow* window, int width, int height)
 	char ins4Name[50];
 	strcpy(ins4Name, "~ F/S to alter bomb speed. ");
 
-
-	fLoose = new FTGLFont(&Matrices, colArrayFont, fileString, looseName, 40.0f, -40.0f, 0.0f, 1.0f);
-	fWin = new FTGLFont(&Matrices, colArrayFont, fileString, winName, 40.0f, -40.0f, 0.0f, 1.0f);
-	f1 = new FTGLFont(&Matrices, colArrayFont, fileString, wordName, 20.0f, -50.0f, TOP_BOUND - 6.0f, 1.0f);
-	f2 = new FTGLFont(&Matrices, colArrayFont, fileString, wordName2, 13.0f, LEFT_BOUND + 1.0f, TOP_BOUND - 10.0f, 1.0f);
-	f3 = new FTGLFont(&Matrices, colArrayFont, fileString, wordName3, 13.0f, LEFT_BOUND + 1.0f, TOP_BOUND - 15.0f, 1.0f);
-	fScore = new FTGLFont(&Matrices, colArrayFont, fileString, wordName4, 13.0f, LEFT_BOUND + 1.0f, TOP_BOUND - 20.0f, 1.0f);
-	fEnter = new FTGLFont(&Matrices, colArrayFont, fileString, enterName, 13.0f, LEFT_BOUND + 60.0f, TOP_BOUND - 60.0f, 1.0f);
-	fIns1 = new FTGLFont(&Matrices, colArrayFont, fileString2, ins1Name, 13.0f, LEFT_BOUND + 10.0f, TOP_BOUND - 20.0f, 0.7f);
-    fIns2 = new FTGLFont(&Matrices, colArrayFont, fileString2, ins2Name, 13.0f, LEFT_BOUND + 10.0f, TOP_BOUND - 30.0f, 0.7f);
-    fIns3 = new FTGLFont(&Matrices, colArrayFont, fileString2, ins3Name, 13.0f, LEFT_BOUND + 10.0f, TOP_BOUND - 40.0f, 0.7f);
-   	fIns4 = new FTGLFont(&Matrices, colArrayFont, fileString2, ins4Name, 13.0f, LEFT_BOUND + 10.0f, TOP_BOUND - 50.0f, 0.7f);
+	f1 = new TextLabel(&Matrices, colArrayFont, fileString, wordName, 20.0f, -50.0f, TOP_BOUND - 6.0f, 1.0f);
+	fEnter = new TextLabel(&Matrices, colArrayFont, fileString, enterName, 13.0f, LEFT_BOUND + 60.0f, TOP_BOUND - 60.0f, 1.0f);
+	fIns1 = new TextLabel(&Matrices, colArrayFont, fileString2, ins1Name, 13.0f, LEFT_BOUND + 10.0f, TOP_BOUND - 20.0f, 0.7f);
+    fIns2 = new TextLabel(&Matrices, colArrayFont, fileString2, ins2Name, 13.0f, LEFT_BOUND + 10.0f, TOP_BOUND - 30.0f, 0.7f);
+    fIns3 = new TextLabel(&Matrices, colArrayFont, fileString2, ins3Name, 13.0f, LEFT_BOUND + 10.0f, TOP_BOUND - 40.0f, 0.7f);
+   	fIns4 = new TextLabel(&Matrices, colArrayFont, fileString2, ins4Name, 13.0f, LEFT_BOUND + 10.0f, TOP_BOUND - 50.0f, 0.7f);
 
     cout << "VENDOR: " << glGetString(GL_VENDOR) << endl;
     cout << "RENDERER: " << glGetString(GL_RENDERER) << endl;
@@ -2124,84 +2659,641 @@ void initGL (GLFWwindow* window, int width, int height)
     cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
 }
 
+/* The world, the cannon and the simulation that steps them. Needs no
+ * GL, replays run on just this. */
+void initSimulation ()
+{
+  world = new World(LEFT_BOUND, RIGHT_BOUND, TOP_BOUND, BOTTOM_BOUND);
+  can = new Cannon(&Matrices, world, BOMB_POOL_SIZE, (int)level->getCannonX(), (int)level->getCannonY());
+  can->setSalvo(SALVO_MODE);
+  level->build(world);
+  simulation = new Simulation();
+  simulation->setRecorder(recorder);
+}
+
+/* Everything past the splash screen: the level, the scene shaders and
+ * the end of game text. Runs after the first frame is shown. */
+void initGame ()
+{
+  PROFILE_ZONE("initGame");
+  circleBatch = new CircleBatch();
+  rectBatch = new RectBatch();
+  initSimulation();
+
+  float colorTarget[3];
+  colorTarget[0] = 0.4f;
+  colorTarget[1] = 0.0f;
+  colorTarget[2] = 0.4f;
+  for(int i = 0; i < world->getObstacleList().size(); i++)
+    blockViews.push_back(new BlockView(&Matrices, world->getObstacleList()[i]));
+  for(int i = 0; i < world->getTargetList().size(); i++)
+    targetViews.push_back(new BallView(&Matrices, colorTarget, world->getTargetList()[i]));
+	//createTriangle (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
+	//createRectangle ();
+	
+	// Create and compile our GLSL program from the shaders
+	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
+	circleProgramID = LoadShaders( "CircleInstanced.vert", "Sample_GL.frag" );
+	rectProgramID = LoadShaders( "RectInstanced.vert", "Sample_GL.frag" );
+	// Get a handle for our "placement" uniform
+	Matrices.PlacementID = glGetUniformLocation(programID, "placement");
+	bindFrameUniforms(programID);
+	bindFrameUniforms(circleProgramID);
+	bindFrameUniforms(rectProgramID);
+
+	float colArrayFont[3];
+	colArrayFont[0] = 0;
+	colArrayFont[1] = 0;
+	colArrayFont[2] = 0;
+
+	char fileString[20]; 
+	strcpy(fileString, "kimberly.ttf");
+
+	char looseName[50];
+	strcpy(looseName, "\tYou Loose !!!\t");
+
+	char winName[50];
+	strcpy(winName, "\tYou Win !!!\t");
+
+	fLoose = new TextLabel(&Matrices, colArrayFont, fileString, looseName, 40.0f, -40.0f, 0.0f, 1.0f);
+	fWin = new TextLabel(&Matrices, colArrayFont, fileString, winName, 40.0f, -40.0f, 0.0f, 1.0f);
+	hud = new Hud(&Matrices, colArrayFont, fileString, 13.0f, LEFT_BOUND + 1.0f, TOP_BOUND - 10.0f, 5.0f);
+
+	// every request has been handed over, the workers are done
+	delete loader;
+	loader = NULL;
+}
+
+/* One fixed physics step plus the game logic that runs with it, on
+ * the simulation thread */
+void updateGame(float timeInstance)
+{
+    PROFILE_ZONE("updateGame");
+    world->step(timeInstance);
+    gameScore = world->getScore();
+	if(can->getShotsLeft() == 0){
+		gameLoose = true;
+	}
+	if(world->isCleared()){
+		gameWin = true;
+	}
+}
+
+double elapsedMilliseconds(const struct timespec &from, const struct timespec &to)
+{
+	return (to.tv_sec - from.tv_sec) * 1000.0 + (to.tv_nsec - from.tv_nsec) / 1000000.0;
+}
+
+double monotonicSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+/* Publishes the state the world starts in, so latest() always has a
+ * snapshot to give */
+Simulation::Simulation()
+{
+	running.store(false);
+	accumulator = 0.0;
+	tick = 0;
+	recorder = NULL;
+	checkpoint = new StateArena(getStateSize(), 1);
+	hasCheckpoint = false;
+	publish();
+}
+
+Simulation::~Simulation()
+{
+	stop();
+	delete checkpoint;
+}
+
+size_t Simulation::getStateSize()
+{
+	return sizeof(GameState) + world->getStateSize();
+}
+
+/* The whole game as getStateSize() plain bytes, for checkpoints,
+ * rollback and trying a shot ahead. Simulation thread only. No GL
+ * object is touched, the views pick the restored state up from the
+ * next snapshot. The camera is the renderer's and is not saved; the
+ * tick keeps counting so recordings stay in order. */
+void Simulation::saveState(void *out)
+{
+	GameState state;
+	state.cannon = can->getState();
+	state.score = gameScore;
+	state.win = gameWin;
+	state.loose = gameLoose;
+	memcpy(out, &state, sizeof(state));
+	world->saveState((unsigned char*)out + sizeof(state));
+}
+
+bool Simulation::loadState(const void *in)
+{
+	if(!world->loadState((const unsigned char*)in + sizeof(GameState)))
+		return false;
+	GameState state;
+	memcpy(&state, in, sizeof(state));
+	can->setState(state.cannon);
+	gameScore = state.score;
+	gameWin = state.win;
+	gameLoose = state.loose;
+	return true;
+}
+
+/* Everything a replay has to reproduce, bit for bit */
+uint64_t gameStateHash()
+{
+	uint64_t hash = can->stateHash(world->stateHash());
+	int outcome[3] = {gameScore, gameWin, gameLoose};
+	return hashBytes(hash, outcome, sizeof(outcome));
+}
+
+/* Main thread only, the queue has a single producer. Applied by the
+ * first physics step that ends after the input was sent. */
+void Simulation::send(int type, float a, float b, float c, float d)
+{
+	GameInput input;
+	input.type = type;
+	input.args[0] = a;
+	input.args[1] = b;
+	input.args[2] = c;
+	input.args[3] = d;
+	input.time = monotonicSeconds();
+	if(!inputs.push(input))
+		cout << "Input dropped, the simulation is behind" << endl;
+}
+
+/* Everything sent up to until, in the order it was sent */
+void Simulation::applyInputs(double until)
+{
+	GameInput *next;
+	while((next = inputs.front()) != NULL && next->time <= until){
+		GameInput input = *next;
+		inputs.pop();
+		applyInput(input);
+	}
+}
+
+static int inputArgCount(int type)
+{
+	if(type == INPUT_AIM)
+		return 2;
+	if(type == INPUT_BOUNDS)
+		return 4;
+	return 0;
+}
+
+/* Logged with the tick it is applied on when recording */
+void Simulation::applyInput(const GameInput &input)
+{
+	if(recorder != NULL && !recorder->writeInput(tick, input.type, input.args, inputArgCount(input.type))){
+		cout << "Error: " << recorder->getError() << ", recording stopped" << endl;
+		recorder = NULL;
+	}
+	switch(input.type){
+		case INPUT_BARREL_UP:
+			can->barrelUp();
+			break;
+		case INPUT_BARREL_DOWN:
+			can->barrelDown();
+			break;
+		case INPUT_SPEED_UP:
+			can->increaseSpeed();
+			break;
+		case INPUT_SPEED_DOWN:
+			can->decreaseSpeed();
+			break;
+		case INPUT_SHOOT:
+			can->shoot();
+			break;
+		case INPUT_AIM:
+			can->setBarrelAngle(input.args[0]);
+			can->setBombInitSpeed(input.args[1]);
+			break;
+		case INPUT_BOUNDS:
+			world->setBounds(input.args[0], input.args[1], input.args[2], input.args[3]);
+			break;
+		case INPUT_CHECKPOINT:
+			saveState(checkpoint->getSlot(0));
+			hasCheckpoint = true;
+			cout << "Checkpoint saved" << endl;
+			break;
+		case INPUT_ROLLBACK:
+			if(hasCheckpoint && loadState(checkpoint->getSlot(0)))
+				cout << "Back to the checkpoint" << endl;
+			break;
+		default:
+			break;
+	}
+}
+
+/* One tick, with a state hash in the recording every
+ * RECORD_CHECK_TICKS of them */
+void Simulation::step()
+{
+	updateGame(PHYSICS_STEP);
+	tick++;
+	if(recorder != NULL && tick % RECORD_CHECK_TICKS == 0 && !recorder->writeCheck(tick, gameStateHash())){
+		cout << "Error: " << recorder->getError() << ", recording stopped" << endl;
+		recorder = NULL;
+	}
+}
+
+void Simulation::publish()
+{
+	WorldSnapshot &snapshot = snapshots.write();
+	can->capture(snapshot);
+	std::vector<Block*> &obstacles = world->getObstacleList();
+	snapshot.blocks.resize(obstacles.size());
+	for(int i = 0; i < obstacles.size(); i++){
+		BodyState &state = snapshot.blocks[i];
+		state.prevX = obstacles[i]->getPrevPositionX();
+		state.x = obstacles[i]->getPositionX();
+		state.y = state.prevY = obstacles[i]->getPositionY();
+		state.present = true;
+	}
+	std::vector<Target*> &targets = world->getTargetList();
+	snapshot.targets.resize(targets.size());
+	for(int i = 0; i < targets.size(); i++){
+		BodyState &state = snapshot.targets[i];
+		state.prevX = targets[i]->getPrevPositionX();
+		state.prevY = targets[i]->getPrevPositionY();
+		state.x = targets[i]->getPositionX();
+		state.y = targets[i]->getPositionY();
+		state.present = targets[i]->isPresent();
+	}
+	snapshot.score = gameScore;
+	snapshot.win = gameWin;
+	snapshot.loose = gameLoose;
+	snapshot.alpha = (float)(accumulator / PHYSICS_STEP);
+	snapshot.time = monotonicSeconds();
+	snapshots.publish();
+}
+
+/* Runs as many fixed steps as elapsed seconds of game time need, but
+ * never more than MAX_STEPS_PER_FRAME so a slow frame can not snowball
+ * into ever longer ones. Time beyond the cap is dropped. now is the
+ * clock at the end of elapsed, so each step takes only the input sent
+ * before the moment it ends; without it every queued input goes to the
+ * first step. Publishes the result, with how far the leftover time is
+ * into the next step for draw(). Only ever called from one thread. */
+void Simulation::advance(double elapsed, double now)
+{
+	PROFILE_ZONE("stepGame");
+	accumulator += elapsed;
+	int steps = 0;
+	while(accumulator >= PHYSICS_STEP && steps < MAX_STEPS_PER_FRAME){
+		accumulator -= PHYSICS_STEP;
+		applyInputs(now - accumulator);
+		step();
+		steps++;
+	}
+	if(accumulator >= PHYSICS_STEP)
+		accumulator = fmod(accumulator, (double)PHYSICS_STEP);
+	publish();
+}
+
+/* The render thread's view of the game. Stays valid until the next
+ * call on the same thread. */
+WorldSnapshot& Simulation::latest()
+{
+	return snapshots.read();
+}
+
+void Simulation::start()
+{
+	running.store(true);
+	thread = std::thread(&Simulation::run, this);
+}
+
+/* Stops the thread and ends any recording on the tick reached */
+void Simulation::stop()
+{
+	running.store(false);
+	if(thread.joinable())
+		thread.join();
+	if(recorder != NULL){
+		if(recorder->finish(tick, gameStateHash()))
+			cout << "Recorded " << tick << " ticks" << endl;
+		else
+			cout << "Error: " << recorder->getError() << endl;
+		recorder = NULL;
+	}
+}
+
+/* Not while the thread runs. Recording starts from the current tick. */
+void Simulation::setRecorder(InputLogWriter *recorder)
+{
+	this->recorder = recorder;
+}
+
+uint64_t Simulation::getTick()
+{
+	return tick;
+}
+
+/* Steps the world through a log as fast as it goes, each input on the
+ * tick it was recorded on, and compares the state at every check.
+ * Stops at the first one that differs. Needs a fresh simulation. */
+bool Simulation::replay(InputLogReader &log)
+{
+	InputRecord record;
+	int inputCount = 0, checkCount = 0;
+	while(log.next(record)){
+		while(tick < record.tick)
+			step();
+		if(record.kind == INPUT_LOG_CHECK || record.kind == INPUT_LOG_END){
+			uint64_t hash = gameStateHash();
+			if(hash != record.hash){
+				printf("Replay differs at tick %llu: state %016llx, recorded %016llx\n",
+				       (unsigned long long)tick, (unsigned long long)hash, (unsigned long long)record.hash);
+				return false;
+			}
+			checkCount++;
+			if(record.kind == INPUT_LOG_END){
+				printf("Replay matches: %llu ticks, %d inputs, %d checks\n",
+				       (unsigned long long)tick, inputCount, checkCount);
+				return true;
+			}
+			continue;
+		}
+		GameInput input;
+		memset(&input, 0, sizeof(input));
+		input.type = record.kind;
+		for(int k = 0; k < record.argCount; k++)
+			input.args[k] = record.args[k];
+		applyInput(input);
+		inputCount++;
+	}
+	cout << "Error: " << log.getError() << endl;
+	return false;
+}
+
+/* Wakes every PHYSICS_STEP on the monotonic clock. When it falls more
+ * than a step behind the schedule restarts from now, advance()'s cap
+ * already drops the time it could not catch up on. */
+void Simulation::run()
+{
+	PROFILE_THREAD("simulation");
+	struct timespec wake;
+	clock_gettime(CLOCK_MONOTONIC, &wake);
+	double last = monotonicSeconds();
+	long period = (long)(PHYSICS_STEP * 1000000000.0);
+	while(running.load()){
+		wake.tv_nsec += period;
+		while(wake.tv_nsec >= 1000000000L){
+			wake.tv_nsec -= 1000000000L;
+			wake.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+		double now = monotonicSeconds();
+		advance(now - last, now);
+		last = now;
+		if(now - (wake.tv_sec + wake.tv_nsec / 1000000000.0) > PHYSICS_STEP)
+			clock_gettime(CLOCK_MONOTONIC, &wake);
+	}
+}
+
+/* The game view drawn HEADLESS_FRAMES times into an offscreen
+ * framebuffer, each frame HEADLESS_FRAME_TIME of game time apart.
+ * Prints the update and draw times, draw includes waiting for the GL
+ * to finish since there is no swap to do that. The simulation is
+ * advanced on this thread instead of its own, so every run matches. */
+void runHeadless (int width, int height)
+{
+	OffscreenContext offscreen;
+	if(!offscreen.create(width, height)){
+		cout << "Error: " << offscreen.getError() << endl;
+		exit(EXIT_FAILURE);
+	}
+	initGL(NULL, width, height);
+	initGame();
+	gameSplash = true;
+
+	FILE *log = NULL;
+	if(HEADLESS_LOG != NULL){
+		log = fopen(HEADLESS_LOG, "w");
+		if(log == NULL){
+			cout << "Error: could not write `" << HEADLESS_LOG << "'" << endl;
+			exit(EXIT_FAILURE);
+		}
+		fprintf(log, "frame,update_ms,draw_ms\n");
+	}
+	bool dumpEach = HEADLESS_DUMP != NULL && strchr(HEADLESS_DUMP, '%') != NULL;
+	std::vector<double> drawTimes;
+	double updateTotal = 0.0;
+	for(int frame = 0; frame < HEADLESS_FRAMES; frame++){
+		PROFILE_ZONE("frame");
+		struct timespec start, updated, drawn;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		simulation->advance(HEADLESS_FRAME_TIME);
+		clock_gettime(CLOCK_MONOTONIC, &updated);
+		WorldSnapshot &snapshot = simulation->latest();
+		draw(&snapshot, snapshot.alpha);
+		{
+			PROFILE_ZONE("glFinish");
+			glFinish();
+		}
+		clock_gettime(CLOCK_MONOTONIC, &drawn);
+
+		double updateTime = elapsedMilliseconds(start, updated);
+		double drawTime = elapsedMilliseconds(updated, drawn);
+		updateTotal += updateTime;
+		drawTimes.push_back(drawTime);
+		if(log != NULL)
+			fprintf(log, "%d,%.3f,%.3f\n", frame, updateTime, drawTime);
+		if(dumpEach || (HEADLESS_DUMP != NULL && frame == HEADLESS_FRAMES - 1)){
+			char path[512];
+			snprintf(path, sizeof(path), HEADLESS_DUMP, frame);
+			if(!offscreen.savePPM(path))
+				cout << "Error: " << offscreen.getError() << " `" << path << "'" << endl;
+		}
+	}
+	if(log != NULL)
+		fclose(log);
+
+	std::vector<double> sorted(drawTimes);
+	sort(sorted.begin(), sorted.end());
+	double drawTotal = 0.0;
+	for(int i = 0; i < sorted.size(); i++)
+		drawTotal += sorted[i];
+	int frames = sorted.size();
+	printf("%d frames %dx%d, update %.3f ms/frame, draw mean %.3f median %.3f p95 %.3f max %.3f ms\n",
+	       frames, width, height, updateTotal / frames, drawTotal / frames,
+	       sorted[frames / 2], sorted[min(frames - 1, (int)(frames * 0.95))], sorted[frames - 1]);
+}
+
 int main (int argc, char** argv)
 {
 	int width = WINDOW_WIDTH;
 	int height = WINDOW_HEIGHT;
 
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc)
+			MAX_STEPS_PER_FRAME = max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i], "--salvo") == 0 && i + 1 < argc){
+			BOMB_POOL_SIZE = max(1, atoi(argv[++i]));
+			SALVO_MODE = true;
+		}
+		else if(strcmp(argv[i], "--level") == 0 && i + 1 < argc)
+			LEVEL_FILE = argv[++i];
+		else if(strcmp(argv[i], "--no-shader-cache") == 0)
+			SHADER_CACHE = false;
+		else if(strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+			ASSET_PACK_FILE = argv[++i];
+		else if(strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+			HEADLESS_FRAMES = max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+			HEADLESS_DUMP = argv[++i];
+		else if(strcmp(argv[i], "--frame-log") == 0 && i + 1 < argc)
+			HEADLESS_LOG = argv[++i];
+		else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			PROFILE_TRACE = argv[++i];
+		else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			RECORD_FILE = argv[++i];
+		else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			REPLAY_FILE = argv[++i];
+	}
+
+	// A replay starts from the level and settings it was recorded with,
+	// the level from the copy in the log unless --level names another
+	InputLogReader replayLog;
+	bool levelFromLog = false;
+	if(REPLAY_FILE != NULL){
+		if(!replayLog.open(REPLAY_FILE)){
+			cout << "Error: " << replayLog.getError() << endl;
+			exit(EXIT_FAILURE);
+		}
+		const InputLogHeader &header = replayLog.getHeader();
+		if(header.step != PHYSICS_STEP){
+			cout << "Error: " << REPLAY_FILE << ": recorded with another physics step" << endl;
+			exit(EXIT_FAILURE);
+		}
+		if(LEVEL_FILE == NULL){
+			LEVEL_FILE = header.level.c_str();
+			levelFromLog = !header.levelData.empty();
+		}
+		BOMB_POOL_SIZE = header.poolSize;
+		SALVO_MODE = header.salvo;
+	}
+
+	// Without a pack every asset is read from the working directory as before
+	std::string packPath = ASSET_PACK_FILE != NULL ? ASSET_PACK_FILE : besideExecutable("assets.pack");
+	assets = new AssetPack();
+	if(!assets->open(packPath.c_str())){
+		if(ASSET_PACK_FILE != NULL){
+			cout << "Error: " << assets->getError() << endl;
+			exit(EXIT_FAILURE);
+		}
+		cout << "No asset pack, using loose files: " << assets->getError() << endl;
+	}
+	std::string levelPath = LEVEL_FILE != NULL ? LEVEL_FILE : besideExecutable("level1.txt");
+	if(LEVEL_FILE == NULL && access(levelPath.c_str(), R_OK) != 0)
+		levelPath = "level1.txt";
+
+	// The level decides the starting view, so it is read before the window exists
+	level = new Level();
+	const std::string &loggedLevel = replayLog.getHeader().levelData;
+	bool loaded = levelFromLog
+		? level->loadMemory(levelPath.c_str(), loggedLevel.data(), loggedLevel.size())
+		: level->load(levelPath.c_str());
+	if(!loaded){
+		cout << "Error: " << level->getError() << endl;
+		exit(EXIT_FAILURE);
+	}
+	if(REPLAY_FILE != NULL && !levelFromLog && !loggedLevel.empty() && readWholeFile(levelPath.c_str()) != loggedLevel)
+		cout << levelPath << " is not the level " << REPLAY_FILE << " was recorded on, the replay will differ" << endl;
+	LEFT_BOUND = level->getLeft();
+	RIGHT_BOUND = level->getRight();
+	TOP_BOUND = level->getTop();
+	BOTTOM_BOUND = level->getBottom();
+
 	gameWin = false; 
 	gameLoose = false;
 	gameScore = 0;
 	gameSplash = false;
 
+	PROFILE_THREAD("main");
+	if(REPLAY_FILE != NULL){
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		initSimulation();
+		bool matches = simulation->replay(replayLog);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double time = elapsedMilliseconds(start, end);
+		printf("Replayed in %.1f ms, %.0f ticks/s\n", time, simulation->getTick() / (time / 1000.0));
+		exportTrace();
+		exit(matches ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	if(RECORD_FILE != NULL){
+		InputLogHeader header;
+		char *absolute = realpath(levelPath.c_str(), NULL);
+		header.level = absolute != NULL ? absolute : levelPath;
+		free(absolute);
+		header.levelData = readWholeFile(levelPath.c_str());
+		if(header.levelData.empty()){
+			cout << "Error: " << levelPath << ": could not read level" << endl;
+			exit(EXIT_FAILURE);
+		}
+		header.poolSize = BOMB_POOL_SIZE;
+		header.salvo = SALVO_MODE;
+		header.step = PHYSICS_STEP;
+		recorder = new InputLogWriter();
+		if(!recorder->open(RECORD_FILE, header)){
+			cout << "Error: " << recorder->getError() << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(HEADLESS_FRAMES > 0){
+		runHeadless(width, height);
+		simulation->stop();
+		exportTrace();
+		exit(EXIT_SUCCESS);
+	}
+
     GLFWwindow* window = initGLFW(width, height);
 
 	initGL (window, width, height);
 
-    double last_update_time = glfwGetTime(), current_time;
+	// Splash screen up before the rest is loaded
+	draw(NULL, 0.0f);
+	glfwSwapBuffers(window);
+	initGame();
+	simulation->start();
 
     /* Draw in loop */
     while (!glfwWindowShouldClose(window)) {
+        PROFILE_ZONE("frame");
+
+        // Poll for Keyboard and mouse events
+        {
+            PROFILE_ZONE("glfwPollEvents");
+            glfwPollEvents();
+        }
+
+        checkPan(window);
+
+        // The newest physics step, blended forward by the time since it
+        // was published so motion stays smooth between steps
+        WorldSnapshot &snapshot = simulation->latest();
+        float alpha = snapshot.alpha + (float)((monotonicSeconds() - snapshot.time) / PHYSICS_STEP);
+        if(alpha > 1.0f)
+            alpha = 1.0f;
 
         // OpenGL Draw commands
-        draw();
+        draw(&snapshot, alpha);
 
         // Swap Frame Buffer in double buffering
+        PROFILE_ZONE("glfwSwapBuffers");
         glfwSwapBuffers(window);
-
-        // Poll for Keyboard and mouse events
-        glfwPollEvents();
-        int tempB;
-		char str[50];
-		char strB[50];
-		strcpy(strB,"Speed:");
-
-		char strC[50];
-		strcpy(strC,"Shots:");
-
-		char strD[50];
-		strcpy(strD,"Score:");
-
-        // Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
-        current_time = glfwGetTime(); // Time in seconds
-        if ((current_time - last_update_time) >= 0.01) { // atleast 0.5s elapsed since last frame
-            // do something every 0.5 seconds ..
-            last_update_time = current_time;
-            can->applyForces(0.01f);
-            b1->applyForces(0.01f);
-            b2->applyForces(0.01f);
-            b3->applyForces(0.01f);
-            b4->applyForces(0.01f);
-           	//b5->applyForces(0.01f);
-            t1->applyForces(0.01f);
-            t2->applyForces(0.01f);
-            t3->applyForces(0.01f);
-            t4->applyForces(0.01f);
-            //t5->applyForces(0.01f);
-            handleCollisionsItem();
- 			handleCollisionsBlock();
- 			handleCollisionsWall();
- 			checkPan(window);
- 			tempB = (int)can->getBombInitSpeed();
- 			sprintf(str, "%d", tempB);
- 			strcat(strB,str);
- 			f2->setWord(strB);
- 			tempB = can->getShotsLeft();
- 			if(tempB == 0){
- 				gameLoose = true;
- 			}
- 			sprintf(str, "%d", tempB);
- 			strcat(strC,str);
- 			f3->setWord(strC);
- 			sprintf(str, "%d", gameScore);
- 			strcat(strD,str);
- 			fScore->setWord(strD);
- 			if(gameScore == movableList.size()-1){
- 				gameWin = true;
- 			}
-        }
     }
 
+    simulation->stop();
+    exportTrace();
     glfwTerminate();
     exit(EXIT_SUCCESS);
 }
@@ -1,14 +1,19 @@
 #version 330 core
 
 // Interpolated values from the vertex shaders
+in vec2 fragTexCoord;
 in vec3 fragColor;
 
 // output data
 out vec3 color;
 
+// Coverage of every glyph, one channel
+uniform sampler2D glyphAtlas;
+
 void main()
 {
-    // Output color = color specified in the vertex shader,
-    // interpolated between all 3 surrounding vertices of the triangle
+    // Solid text like the old outline fonts, no blending needed
+    if(texture(glyphAtlas, fragTexCoord).r < 0.5)
+        discard;
     color = fragColor;
-}
\ No newline at end of file
+}
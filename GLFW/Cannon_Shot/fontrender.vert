@@ -1,17 +1,23 @@
 #version 330 core
 
-uniform mat4 MVP;
-uniform vec3 pen;
-uniform vec3 fontColor;
+// input data : glyph quads already placed by the text batch
+layout (location = 0) in vec2 vertexPosition;
+layout (location = 1) in vec2 vertexTexCoord;
+layout (location = 2) in vec3 vertexColor;
 
-in vec3 vertexPosition;
-in vec3 vertexNormal;
+// shared by every program, filled once per frame
+layout (std140) uniform Frame {
+    mat4 sceneVP;   // projection * view, the camera follows the pan
+    mat4 screenVP;  // projection * fixed view, for the background and text
+};
 
+// output data : used by fragment shader
+out vec2 fragTexCoord;
 out vec3 fragColor;
 
 void main ()
 {
-    gl_Position = MVP * (vec4(vertexPosition, 1.0) + vec4(pen, 1.0));
-    // fragColor = vec3((vertexNormal.x+1)/2,(vertexNormal.y+1)/2,(vertexNormal.z+1)/2);
-    fragColor = fontColor;
-}
\ No newline at end of file
+    fragTexCoord = vertexTexCoord;
+    fragColor = vertexColor;
+    gl_Position = screenVP * vec4(vertexPosition, 0, 1);
+}
@@ -0,0 +1,225 @@
+#include <cmath>
+#include <algorithm>
+
+#include "grid.h"
+
+using namespace std;
+
+const float MAX_SWEPT_CELLS = 64.0f;  // cells one body's sweep may take
+
+SpatialGrid::SpatialGrid(){
+  this->cellSize = 0.0f;
+  this->usedCellSize = 0.0f;
+  this->radiusPercentile = 0.9f;
+  // checkCollisionItem accepts centres up to sqrt(5) past touching,
+  // half of that per body plus some slack for the pushes that
+  // simulateCollisionItem applies while the pairs are being resolved.
+  // A body pushed further is looked up again, see handleCollisionsItem
+  this->padding = 2.2f;
+  this->tableMask = 0;
+}
+
+/* A size of 0 fits the cell size to the radii on every rebuild */
+void SpatialGrid::setCellSize(float size){
+  this->cellSize = size;
+}
+
+/* Which radius the fitted cell size is made for. 1.0 sizes cells for
+ * the largest body, lower values give smaller cells and let the few
+ * big bodies spread over several of them */
+void SpatialGrid::setRadiusPercentile(float percentile){
+  if(percentile < 0.0f)percentile = 0.0f;
+  else if(percentile > 1.0f)percentile = 1.0f;
+  this->radiusPercentile = percentile;
+}
+
+void SpatialGrid::setPadding(float padding){
+  this->padding = padding;
+}
+
+float SpatialGrid::getCellSize(){
+  return usedCellSize;
+}
+
+float SpatialGrid::getPadding(){
+  return padding;
+}
+
+float SpatialGrid::fitCellSize(BodyStore &bodies){
+  int n = bodies.size();
+  if(n == 0)
+    return 1.0f;
+  radii.assign(bodies.radius.begin(), bodies.radius.end());
+  int k = (int)(radiusPercentile * (n - 1));
+  nth_element(radii.begin(), radii.begin() + k, radii.end());
+  return 2.0f * (radii[k] + padding);
+}
+
+int SpatialGrid::hashCell(int cx, int cy){
+  unsigned int h = (unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u;
+  return (int)(h & (unsigned int)tableMask);
+}
+
+/* Hashes every present body into the buckets its box covers. The box
+ * is the body padded by padding, or with swept, the box around where it
+ * was and where it is now. */
+void SpatialGrid::fillBuckets(BodyStore &bodies, bool swept){
+  int n = bodies.size();
+  usedCellSize = cellSize > 0.0f ? cellSize : fitCellSize(bodies);
+  float inv = 1.0f / usedCellSize;
+  int tableSize = 1;
+  while(tableSize < 2 * n)
+    tableSize <<= 1;
+  tableMask = tableSize - 1;
+
+  // Count how many bodies land in every bucket
+  spans.resize(n);
+  cellStart.assign(tableSize + 1, 0);
+  oversized.clear();
+  bucketed.clear();
+  for(int i = 0; i < n; i++){
+    CellSpan &span = spans[i];
+    if(bodies.present[i] <= 0.0f){
+      // parked bodies get an empty span and never land in a bucket
+      span.x0 = span.y0 = 0;
+      span.x1 = span.y1 = -1;
+      continue;
+    }
+    if(swept){
+      float r = bodies.radius[i];
+      float x0 = floorf((min(bodies.prevX[i], bodies.x[i]) - r) * inv);
+      float x1 = floorf((max(bodies.prevX[i], bodies.x[i]) + r) * inv);
+      float y0 = floorf((min(bodies.prevY[i], bodies.y[i]) - r) * inv);
+      float y1 = floorf((max(bodies.prevY[i], bodies.y[i]) + r) * inv);
+      // a body thrown far in one step would fill the table, it is kept
+      // aside with its box for query() to test. NaN lands here too.
+      if(!((x1 - x0 + 1.0f) * (y1 - y0 + 1.0f) <= MAX_SWEPT_CELLS)){
+        SweptBox box;
+        box.id = i;
+        box.minX = min(bodies.prevX[i], bodies.x[i]) - r;
+        box.maxX = max(bodies.prevX[i], bodies.x[i]) + r;
+        box.minY = min(bodies.prevY[i], bodies.y[i]) - r;
+        box.maxY = max(bodies.prevY[i], bodies.y[i]) + r;
+        oversized.push_back(box);
+        span.x0 = span.y0 = 0;
+        span.x1 = span.y1 = -1;
+        continue;
+      }
+      span.x0 = (int)x0;
+      span.x1 = (int)x1;
+      span.y0 = (int)y0;
+      span.y1 = (int)y1;
+    }
+    else{
+      float reach = bodies.radius[i] + padding;
+      span.x0 = (int)floorf((bodies.x[i] - reach) * inv);
+      span.x1 = (int)floorf((bodies.x[i] + reach) * inv);
+      span.y0 = (int)floorf((bodies.y[i] - reach) * inv);
+      span.y1 = (int)floorf((bodies.y[i] + reach) * inv);
+    }
+    bucketed.push_back(i);
+    for(int cx = span.x0; cx <= span.x1; cx++)
+      for(int cy = span.y0; cy <= span.y1; cy++)
+        cellStart[hashCell(cx, cy) + 1]++;
+  }
+  for(int b = 0; b < tableSize; b++)
+    cellStart[b + 1] += cellStart[b];
+
+  // Scatter body ids into their buckets
+  entries.resize(cellStart[tableSize]);
+  cursor.assign(cellStart.begin(), cellStart.end() - 1);
+  for(int i = 0; i < n; i++){
+    CellSpan &span = spans[i];
+    for(int cx = span.x0; cx <= span.x1; cx++)
+      for(int cy = span.y0; cy <= span.y1; cy++)
+        entries[cursor[hashCell(cx, cy)]++] = i;
+  }
+}
+
+void SpatialGrid::rebuild(BodyStore &bodies){
+  int n = bodies.size();
+  pairs.clear();
+  keys.clear();
+  if(n < 2)
+    return;
+  fillBuckets(bodies, false);
+  int tableSize = tableMask + 1;
+
+  // Every pair sharing a bucket is a candidate
+  for(int b = 0; b < tableSize; b++){
+    for(int p = cellStart[b]; p < cellStart[b + 1]; p++){
+      for(int q = p + 1; q < cellStart[b + 1]; q++){
+        int i = entries[p];
+        int j = entries[q];
+        if(i == j)
+          continue;
+        // two sleeping bodies can not start touching
+        if(bodies.awake[i] <= 0.0f && bodies.awake[j] <= 0.0f)
+          continue;
+        if(i > j)
+          swap(i, j);
+        keys.push_back(((unsigned long long)i << 32) | (unsigned int)j);
+      }
+    }
+  }
+  sort(keys.begin(), keys.end());
+  keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+  pairs.resize(keys.size());
+  for(int k = 0; k < keys.size(); k++){
+    pairs[k].first = (int)(keys[k] >> 32);
+    pairs[k].second = (int)(keys[k] & 0xffffffffu);
+  }
+}
+
+std::vector<CandidatePair>& SpatialGrid::getPairs(){
+  return pairs;
+}
+
+/* Buckets every body by the box it swept this step, for query() */
+void SpatialGrid::indexSweeps(BodyStore &bodies){
+  if(bodies.size() == 0){
+    tableMask = 0;
+    cellStart.assign(2, 0);
+    oversized.clear();
+    bucketed.clear();
+    return;
+  }
+  fillBuckets(bodies, true);
+}
+
+/* Appends every body bucketed in a cell the box touches, and the
+ * oversized sweeps the box overlaps, once each and in id order.
+ * Answers from the last indexSweeps() or rebuild(). */
+void SpatialGrid::query(float minX, float minY, float maxX, float maxY, std::vector<int> &out){
+  if(usedCellSize <= 0.0f)
+    return;
+  float inv = 1.0f / usedCellSize;
+  float x0 = floorf(minX * inv);
+  float x1 = floorf(maxX * inv);
+  float y0 = floorf(minY * inv);
+  float y1 = floorf(maxY * inv);
+  int first = out.size();
+  // written so a box with NaN in it is never left out
+  for(int k = 0; k < oversized.size(); k++){
+    SweptBox &box = oversized[k];
+    if(!(box.maxX < minX || box.minX > maxX || box.maxY < minY || box.minY > maxY))
+      out.push_back(box.id);
+  }
+  // a box wider than the table would visit every bucket more than
+  // once, it gets every bucketed body, already in id order
+  if(!((x1 - x0 + 1.0f) * (y1 - y0 + 1.0f) <= tableMask + 1)){
+    int middle = out.size();
+    out.insert(out.end(), bucketed.begin(), bucketed.end());
+    inplace_merge(out.begin() + first, out.begin() + middle, out.end());
+    return;
+  }
+  for(int cx = (int)x0; cx <= (int)x1; cx++)
+    for(int cy = (int)y0; cy <= (int)y1; cy++){
+      int b = hashCell(cx, cy);
+      for(int p = cellStart[b]; p < cellStart[b + 1]; p++)
+        out.push_back(entries[p]);
+    }
+  sort(out.begin() + first, out.end());
+  out.erase(unique(out.begin() + first, out.end()), out.end());
+}
@@ -0,0 +1,65 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+
+#include "bodies.h"
+
+struct CandidatePair {
+  int first;
+  int second;
+};
+typedef struct CandidatePair CandidatePair;
+
+/* Uniform grid broad phase over a BodyStore. Cells are hashed into a
+ * table sized to the body count, so the world needs no fixed extent.
+ * rebuild() returns every pair of bodies whose padded boxes share a
+ * cell and that are not both asleep, sorted by (first, second) and
+ * without duplicates. indexSweeps() buckets the boxes the bodies swept
+ * instead, for query() to look up what a moving box could touch. */
+class SpatialGrid{
+public:
+  SpatialGrid();
+  void setCellSize(float size);
+  void setRadiusPercentile(float percentile);
+  void setPadding(float padding);
+  float getCellSize();
+  float getPadding();
+  float fitCellSize(BodyStore &bodies);
+  void rebuild(BodyStore &bodies);
+  std::vector<CandidatePair>& getPairs();
+  void indexSweeps(BodyStore &bodies);
+  void query(float minX, float minY, float maxX, float maxY, std::vector<int> &out);
+private:
+  struct SweptBox {
+    int id;
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+  };
+  struct CellSpan {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+  };
+  int hashCell(int cx, int cy);
+  void fillBuckets(BodyStore &bodies, bool swept);
+  float cellSize;
+  float usedCellSize;
+  float radiusPercentile;
+  float padding;
+  int tableMask;
+  std::vector<CellSpan> spans;
+  std::vector<int> cellStart;
+  std::vector<int> entries;
+  std::vector<int> cursor;
+  std::vector<SweptBox> oversized;   // sweeps too big to bucket
+  std::vector<int> bucketed;         // ids with a span, in order
+  std::vector<float> radii;
+  std::vector<unsigned long long> keys;
+  std::vector<CandidatePair> pairs;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include <cstdio>
+#include <cstring>
+
+#include "inputlog.h"
+
+using namespace std;
+
+InputLogWriter::InputLogWriter(){
+  this->file = NULL;
+  this->lastTick = 0;
+}
+
+InputLogWriter::~InputLogWriter(){
+  if(file != NULL)
+    fclose(file);
+}
+
+bool InputLogWriter::write(const void *data, size_t size){
+  if(size > 0 && fwrite(data, 1, size, file) != size){
+    error = path + ": could not write input log";
+    return false;
+  }
+  return true;
+}
+
+bool InputLogWriter::writeVarint(uint64_t value){
+  unsigned char bytes[10];
+  int length = 0;
+  do{
+    bytes[length] = value & 0x7f;
+    value >>= 7;
+    if(value != 0)
+      bytes[length] |= 0x80;
+    length++;
+  }while(value != 0);
+  return write(bytes, length);
+}
+
+static void putBits(unsigned char *out, uint64_t bits, int size){
+  for(int k = 0; k < size; k++)
+    out[k] = (bits >> (8 * k)) & 0xff;
+}
+
+static uint64_t getBits(const unsigned char *in, int size){
+  uint64_t bits = 0;
+  for(int k = 0; k < size; k++)
+    bits |= (uint64_t)in[k] << (8 * k);
+  return bits;
+}
+
+bool InputLogWriter::open(const char *path, const InputLogHeader &header){
+  this->path = path;
+  file = fopen(path, "wb");
+  if(file == NULL){
+    error = this->path + ": could not write input log";
+    return false;
+  }
+  lastTick = 0;
+  unsigned char word[4];
+  putBits(word, INPUT_LOG_MAGIC, 4);
+  uint32_t step;
+  memcpy(&step, &header.step, 4);
+  return write(word, 4) && writeVarint(INPUT_LOG_VERSION)
+      && writeVarint(header.poolSize) && writeVarint(header.salvo)
+      && writeVarint(step) && writeVarint(header.level.size())
+      && write(header.level.data(), header.level.size())
+      && writeVarint(header.levelData.size())
+      && write(header.levelData.data(), header.levelData.size());
+}
+
+bool InputLogWriter::isOpen(){
+  return file != NULL;
+}
+
+bool InputLogWriter::writeRecord(uint64_t tick, int kind, int argCount){
+  if(file == NULL)
+    return false;
+  if(tick < lastTick || kind < 0 || kind > INPUT_LOG_END || argCount < 0 || argCount > 4){
+    error = path + ": bad input record";
+    return false;
+  }
+  uint64_t delta = tick - lastTick;
+  lastTick = tick;
+  return writeVarint(delta) && writeVarint(kind << 3 | argCount);
+}
+
+bool InputLogWriter::writeInput(uint64_t tick, int kind, const float *args, int argCount){
+  if(kind >= INPUT_LOG_CHECK || !writeRecord(tick, kind, argCount))
+    return false;
+  unsigned char bytes[16];
+  for(int k = 0; k < argCount; k++){
+    uint32_t bits;
+    memcpy(&bits, &args[k], 4);
+    putBits(bytes + 4 * k, bits, 4);
+  }
+  return write(bytes, 4 * argCount);
+}
+
+bool InputLogWriter::writeCheck(uint64_t tick, uint64_t hash){
+  unsigned char bytes[8];
+  putBits(bytes, hash, 8);
+  return writeRecord(tick, INPUT_LOG_CHECK, 0) && write(bytes, 8);
+}
+
+/* Writes the end record and closes the log */
+bool InputLogWriter::finish(uint64_t tick, uint64_t hash){
+  unsigned char bytes[8];
+  putBits(bytes, hash, 8);
+  bool ok = writeRecord(tick, INPUT_LOG_END, 0) && write(bytes, 8);
+  if(file != NULL && fclose(file) != 0 && ok){
+    error = path + ": could not write input log";
+    ok = false;
+  }
+  file = NULL;
+  return ok;
+}
+
+const char* InputLogWriter::getError(){
+  return error.c_str();
+}
+
+bool InputLogReader::fail(const char *message){
+  error = path + ": " + message;
+  return false;
+}
+
+bool InputLogReader::read(void *out, size_t size){
+  if(data.size() - position < size)
+    return fail("input log is cut short");
+  memcpy(out, &data[position], size);
+  position += size;
+  return true;
+}
+
+bool InputLogReader::readVarint(uint64_t &value){
+  value = 0;
+  for(int shift = 0; shift < 64; shift += 7){
+    if(position >= data.size())
+      return fail("input log is cut short");
+    unsigned char byte = data[position++];
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if((byte & 0x80) == 0)
+      return true;
+  }
+  return fail("input log has a bad number");
+}
+
+/* Reads the log and its header, the records are decoded by next() */
+bool InputLogReader::open(const char *path){
+  this->path = path;
+  error.clear();
+  data.clear();
+  position = 0;
+  lastTick = 0;
+  ended = false;
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+    return fail("could not open input log");
+  unsigned char buffer[65536];
+  size_t got;
+  while((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + got);
+  fclose(file);
+
+  unsigned char word[4];
+  uint64_t version, poolSize, salvo, step, length;
+  if(!read(word, 4) || getBits(word, 4) != INPUT_LOG_MAGIC)
+    return fail("not an input log");
+  if(!readVarint(version))
+    return false;
+  if(version < 1 || version > INPUT_LOG_VERSION)
+    return fail("input log is from another version of the game");
+  if(!readVarint(poolSize) || !readVarint(salvo) || !readVarint(step) || !readVarint(length))
+    return false;
+  if(length > data.size() - position)
+    return fail("input log is cut short");
+  header.poolSize = (int)poolSize;
+  header.salvo = salvo != 0;
+  uint32_t stepBits = (uint32_t)step;
+  memcpy(&header.step, &stepBits, 4);
+  header.level.assign((const char*)&data[position], length);
+  position += length;
+  header.levelData.clear();
+  if(version >= 2){
+    if(!readVarint(length))
+      return false;
+    if(length > data.size() - position)
+      return fail("input log is cut short");
+    header.levelData.assign((const char*)&data[position], length);
+    position += length;
+  }
+  return true;
+}
+
+const InputLogHeader& InputLogReader::getHeader(){
+  return header;
+}
+
+bool InputLogReader::next(InputRecord &record){
+  if(ended || !error.empty())
+    return false;
+  uint64_t delta, tag;
+  if(position >= data.size())
+    return fail("input log has no end record");
+  if(!readVarint(delta) || !readVarint(tag))
+    return false;
+  record.tick = lastTick + delta;
+  lastTick = record.tick;
+  record.kind = (int)(tag >> 3);
+  record.argCount = (int)(tag & 7);
+  record.hash = 0;
+  if(record.kind > INPUT_LOG_END || record.argCount > 4)
+    return fail("input log has a bad record");
+  unsigned char bytes[16];
+  if(record.kind >= INPUT_LOG_CHECK){
+    if(record.argCount != 0)
+      return fail("input log has a bad record");
+    if(!read(bytes, 8))
+      return false;
+    record.hash = getBits(bytes, 8);
+    ended = record.kind == INPUT_LOG_END;
+    return true;
+  }
+  if(!read(bytes, 4 * record.argCount))
+    return false;
+  for(int k = 0; k < record.argCount; k++){
+    uint32_t bits = (uint32_t)getBits(bytes + 4 * k, 4);
+    memcpy(&record.args[k], &bits, 4);
+  }
+  return true;
+}
+
+const char* InputLogReader::getError(){
+  return error.c_str();
+}
@@ -0,0 +1,86 @@
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+#define INPUT_LOG_MAGIC 0x4c495343  // "CSIL" read as a little endian word
+#define INPUT_LOG_VERSION 2  // 2 added the level's bytes, 1 still reads
+
+/* Record kinds past the game's own input types */
+enum InputLogKind {
+  INPUT_LOG_CHECK = 30,  // state hash after a tick
+  INPUT_LOG_END = 31     // state hash where recording stopped, always last
+};
+
+/* What a replay needs to start from the same world */
+struct InputLogHeader {
+  std::string level;      // path the level was read from
+  std::string levelData;  // the level file as recorded, empty in version 1
+  int poolSize;
+  bool salvo;
+  float step;             // PHYSICS_STEP the ticks are counted in
+};
+typedef struct InputLogHeader InputLogHeader;
+
+/* One input, or one check of the state, on the tick it belongs to.
+ * An input is applied before its tick is stepped, a check is taken
+ * once the world has stepped tick times. */
+struct InputRecord {
+  uint64_t tick;
+  int kind;         // the game's input type, or an InputLogKind
+  int argCount;
+  float args[4];
+  uint64_t hash;    // checks only
+};
+typedef struct InputRecord InputRecord;
+
+/* On disk: the magic word, then the header and the records as varints
+ * (LEB128). Strings are a length then their bytes, the level's whole
+ * file is kept so a log replays on a machine that does not have it. A record is the tick minus the last record's, a byte of
+ * kind << 3 | argCount, then argCount floats or a check's hash as raw
+ * little endian bits, so replayed values are exactly the recorded ones.
+ * A shot costs 2 bytes, an aim with the mouse 10. */
+class InputLogWriter{
+public:
+  InputLogWriter();
+  ~InputLogWriter();
+  bool open(const char *path, const InputLogHeader &header);
+  bool writeInput(uint64_t tick, int kind, const float *args, int argCount);
+  bool writeCheck(uint64_t tick, uint64_t hash);
+  bool finish(uint64_t tick, uint64_t hash);
+  bool isOpen();
+  const char* getError();
+private:
+  bool writeRecord(uint64_t tick, int kind, int argCount);
+  bool writeVarint(uint64_t value);
+  bool write(const void *data, size_t size);
+  FILE *file;
+  uint64_t lastTick;
+  std::string path;
+  std::string error;
+};
+
+/* Reads a whole log into memory and hands the records out in order */
+class InputLogReader{
+public:
+  bool open(const char *path);
+  const InputLogHeader& getHeader();
+  bool next(InputRecord &record);  // false at the end, or on a bad record
+  const char* getError();          // empty unless the log is bad
+private:
+  bool fail(const char *message);
+  bool readVarint(uint64_t &value);
+  bool read(void *data, size_t size);
+  std::vector<unsigned char> data;
+  size_t position;
+  uint64_t lastTick;
+  bool ended;
+  InputLogHeader header;
+  std::string path;
+  std::string error;
+};
+
+#endif
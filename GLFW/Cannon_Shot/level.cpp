@@ -0,0 +1,309 @@
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "physics.h"
+#include "level.h"
+
+using namespace std;
+
+Level::Level(){
+  memset(&header, 0, sizeof(header));
+  header.magic = LEVEL_MAGIC;
+  header.version = LEVEL_VERSION;
+  this->blocks = NULL;
+  this->targets = NULL;
+  this->mapping = NULL;
+  this->mappingSize = 0;
+}
+
+Level::~Level(){
+  unmap();
+}
+
+void Level::unmap(){
+  if(mapping != NULL)
+    munmap(mapping, mappingSize);
+  mapping = NULL;
+  mappingSize = 0;
+}
+
+bool Level::fail(const char *path, const char *message, int line){
+  char buffer[512];
+  if(line > 0)
+    snprintf(buffer, sizeof(buffer), "%s:%d: %s", path, line, message);
+  else
+    snprintf(buffer, sizeof(buffer), "%s: %s", path, message);
+  error = buffer;
+  return false;
+}
+
+/* The only per record check either loader does, a target has to
+ * stand on a block that exists */
+bool Level::checkTargets(const char *path){
+  for(int k = 0; k < header.targetCount; k++)
+    if(targets[k].pillar < 0 || targets[k].pillar >= header.blockCount)
+      return fail(path, "target refers to a block that does not exist");
+  return true;
+}
+
+bool Level::load(const char *path){
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+    return fail(path, "could not open level");
+  uint32_t magic = 0;
+  size_t got = fread(&magic, sizeof(magic), 1, file);
+  fclose(file);
+  if(got == 1 && magic == LEVEL_MAGIC)
+    return loadBinary(path);
+  return loadText(path);
+}
+
+bool Level::loadText(const char *path){
+  FILE *file = fopen(path, "r");
+  if(file == NULL)
+    return fail(path, "could not open level");
+  return readText(file, path);
+}
+
+/* Parses the text form and closes file */
+bool Level::readText(FILE *file, const char *path){
+  unmap();
+  textBlocks.clear();
+  textTargets.clear();
+  bool haveBounds = false;
+  char line[256];
+  int lineNumber = 0;
+  while(fgets(line, sizeof(line), file) != NULL){
+    lineNumber++;
+    char *comment = strchr(line, '#');
+    if(comment != NULL)
+      *comment = '\0';
+    char word[16];
+    int used = 0;
+    if(sscanf(line, " %15s%n", word, &used) != 1)
+      continue;
+    char *rest = line + used;
+    bool ok = false;
+    if(strcmp(word, "bounds") == 0){
+      ok = sscanf(rest, "%f %f %f %f", &header.left, &header.right, &header.top, &header.bottom) == 4;
+      haveBounds = ok;
+    }
+    else if(strcmp(word, "cannon") == 0){
+      ok = sscanf(rest, "%f %f", &header.cannonX, &header.cannonY) == 2;
+    }
+    else if(strcmp(word, "block") == 0){
+      LevelBlock block;
+      char kind[16] = "static";
+      int fields = sscanf(rest, "%f %f %f %f %15s", &block.x, &block.y, &block.width, &block.height, kind);
+      block.dynamic = strcmp(kind, "dynamic") == 0;
+      ok = fields >= 4 && (block.dynamic || strcmp(kind, "static") == 0);
+      if(ok)
+        textBlocks.push_back(block);
+    }
+    else if(strcmp(word, "target") == 0){
+      LevelTarget target;
+      ok = sscanf(rest, "%d", &target.pillar) == 1;
+      if(ok)
+        textTargets.push_back(target);
+    }
+    if(!ok){
+      fclose(file);
+      return fail(path, "malformed line", lineNumber);
+    }
+  }
+  fclose(file);
+  if(!haveBounds)
+    return fail(path, "level has no bounds line");
+
+  header.magic = LEVEL_MAGIC;
+  header.version = LEVEL_VERSION;
+  header.blockCount = textBlocks.size();
+  header.targetCount = textTargets.size();
+  header.blockOffset = sizeof(LevelHeader);
+  header.targetOffset = header.blockOffset + header.blockCount * sizeof(LevelBlock);
+  blocks = textBlocks.empty() ? NULL : &textBlocks[0];
+  targets = textTargets.empty() ? NULL : &textTargets[0];
+  return checkTargets(path);
+}
+
+/* What is wrong with a binary header for a file of size bytes, NULL if
+ * nothing is */
+static const char* checkBinaryHeader(const LevelHeader &head, uint64_t size){
+  uint64_t blockEnd = (uint64_t)head.blockOffset + (uint64_t)head.blockCount * sizeof(LevelBlock);
+  uint64_t targetEnd = (uint64_t)head.targetOffset + (uint64_t)head.targetCount * sizeof(LevelTarget);
+  if(head.magic != LEVEL_MAGIC)
+    return "not a binary level";
+  if(head.version != LEVEL_VERSION)
+    return "binary level has an unsupported version";
+  if(blockEnd > size || targetEnd > size || head.blockOffset % 4 != 0 || head.targetOffset % 4 != 0)
+    return "binary level is truncated or corrupt";
+  return NULL;
+}
+
+/* Maps the file read only and points straight into it. The mapping
+ * lives as long as the Level does. */
+bool Level::loadBinary(const char *path){
+  int fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return fail(path, "could not open level");
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(LevelHeader)){
+    close(fd);
+    return fail(path, "file is too small to be a level");
+  }
+  void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+    return fail(path, "could not map level");
+
+  const char *bytes = (const char*)data;
+  LevelHeader head;
+  memcpy(&head, bytes, sizeof(LevelHeader));
+  const char *problem = checkBinaryHeader(head, info.st_size);
+  if(problem != NULL){
+    munmap(data, info.st_size);
+    return fail(path, problem);
+  }
+
+  unmap();
+  textBlocks.clear();
+  textTargets.clear();
+  mapping = data;
+  mappingSize = info.st_size;
+  header = head;
+  blocks = (const LevelBlock*)(bytes + header.blockOffset);
+  targets = (const LevelTarget*)(bytes + header.targetOffset);
+  return checkTargets(path);
+}
+
+/* A level in either form from bytes already in memory, such as the copy
+ * an input log carries. path only names it in errors. The records are
+ * copied, so data does not have to outlive the call. */
+bool Level::loadMemory(const char *path, const void *data, size_t size){
+  uint32_t magic = 0;
+  if(size >= sizeof(magic))
+    memcpy(&magic, data, sizeof(magic));
+  if(magic != LEVEL_MAGIC){
+    if(size == 0)
+      return fail(path, "level has no bounds line");
+    FILE *file = fmemopen((void*)data, size, "r");
+    if(file == NULL)
+      return fail(path, "could not read level");
+    return readText(file, path);
+  }
+  if(size < sizeof(LevelHeader))
+    return fail(path, "file is too small to be a level");
+  const char *bytes = (const char*)data;
+  LevelHeader head;
+  memcpy(&head, bytes, sizeof(LevelHeader));
+  const char *problem = checkBinaryHeader(head, size);
+  if(problem != NULL)
+    return fail(path, problem);
+
+  unmap();
+  header = head;
+  textBlocks.resize(header.blockCount);
+  textTargets.resize(header.targetCount);
+  if(header.blockCount > 0)
+    memcpy(&textBlocks[0], bytes + header.blockOffset, header.blockCount * sizeof(LevelBlock));
+  if(header.targetCount > 0)
+    memcpy(&textTargets[0], bytes + header.targetOffset, header.targetCount * sizeof(LevelTarget));
+  blocks = textBlocks.empty() ? NULL : &textBlocks[0];
+  targets = textTargets.empty() ? NULL : &textTargets[0];
+  return checkTargets(path);
+}
+
+bool Level::saveText(const char *path){
+  FILE *file = fopen(path, "w");
+  if(file == NULL)
+    return fail(path, "could not write level");
+  fprintf(file, "bounds %g %g %g %g\n", header.left, header.right, header.top, header.bottom);
+  fprintf(file, "cannon %g %g\n", header.cannonX, header.cannonY);
+  for(int k = 0; k < header.blockCount; k++)
+    fprintf(file, "block %g %g %g %g %s\n", blocks[k].x, blocks[k].y, blocks[k].width, blocks[k].height,
+            blocks[k].dynamic ? "dynamic" : "static");
+  for(int k = 0; k < header.targetCount; k++)
+    fprintf(file, "target %d\n", targets[k].pillar);
+  fclose(file);
+  return true;
+}
+
+bool Level::saveBinary(const char *path){
+  FILE *file = fopen(path, "wb");
+  if(file == NULL)
+    return fail(path, "could not write level");
+  LevelHeader out = header;
+  out.magic = LEVEL_MAGIC;
+  out.version = LEVEL_VERSION;
+  out.blockOffset = sizeof(LevelHeader);
+  out.targetOffset = out.blockOffset + out.blockCount * sizeof(LevelBlock);
+  bool ok = fwrite(&out, sizeof(out), 1, file) == 1;
+  if(out.blockCount > 0)
+    ok = ok && fwrite(blocks, sizeof(LevelBlock), out.blockCount, file) == out.blockCount;
+  if(out.targetCount > 0)
+    ok = ok && fwrite(targets, sizeof(LevelTarget), out.targetCount, file) == out.targetCount;
+  ok = (fclose(file) == 0) && ok;
+  if(!ok)
+    return fail(path, "could not write level");
+  return true;
+}
+
+/* Adds every block and target to the world, in file order */
+void Level::build(World *world){
+  world->setBounds(header.left, header.right, header.top, header.bottom);
+  world->reserve(header.blockCount, header.targetCount);
+  std::vector<Block*> &obstacles = world->getObstacleList();
+  int base = obstacles.size();
+  for(int k = 0; k < header.blockCount; k++)
+    world->addBlock(blocks[k].x, blocks[k].y, blocks[k].width, blocks[k].height, blocks[k].dynamic != 0);
+  for(int k = 0; k < header.targetCount; k++)
+    world->addTarget(obstacles[base + targets[k].pillar]);
+}
+
+float Level::getLeft(){
+  return header.left;
+}
+
+float Level::getRight(){
+  return header.right;
+}
+
+float Level::getTop(){
+  return header.top;
+}
+
+float Level::getBottom(){
+  return header.bottom;
+}
+
+float Level::getCannonX(){
+  return header.cannonX;
+}
+
+float Level::getCannonY(){
+  return header.cannonY;
+}
+
+int Level::getBlockCount(){
+  return header.blockCount;
+}
+
+int Level::getTargetCount(){
+  return header.targetCount;
+}
+
+const LevelBlock& Level::getBlock(int k){
+  return blocks[k];
+}
+
+const LevelTarget& Level::getTarget(int k){
+  return targets[k];
+}
+
+const char* Level::getError(){
+  return error.c_str();
+}
@@ -0,0 +1,96 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+class World;
+
+#define LEVEL_MAGIC 0x564c5343  // "CSLV" read as a little endian word
+#define LEVEL_VERSION 1
+
+/* On disk records of the binary form. Everything is 4 byte little
+ * endian fields with no padding, so the arrays are used straight out
+ * of the mapped file. */
+struct LevelBlock {
+  float x;
+  float y;
+  float width;
+  float height;
+  int32_t dynamic;
+};
+typedef struct LevelBlock LevelBlock;
+
+struct LevelTarget {
+  int32_t pillar; // index of the block the target sits on
+};
+typedef struct LevelTarget LevelTarget;
+
+struct LevelHeader {
+  uint32_t magic;
+  uint32_t version;
+  float left;
+  float right;
+  float top;
+  float bottom;
+  float cannonX;
+  float cannonY;
+  uint32_t blockCount;
+  uint32_t blockOffset;  // bytes from the start of the file
+  uint32_t targetCount;
+  uint32_t targetOffset;
+};
+typedef struct LevelHeader LevelHeader;
+
+/* A level in either form. The text form is for editing by hand:
+ *
+ *   bounds <left> <right> <top> <bottom>
+ *   cannon <x> <y>
+ *   block <x> <y> <width> <height> [dynamic]
+ *   target <block index>
+ *
+ * one per line, '#' starts a comment. The binary form is the header
+ * followed by the block and target arrays; loadBinary() maps the file
+ * and checks the header and ranges, it never touches a record on its
+ * own. load() and loadMemory() pick the form from the first four bytes. */
+class Level{
+public:
+  Level();
+  ~Level();
+  bool load(const char *path);
+  bool loadText(const char *path);
+  bool loadBinary(const char *path);
+  bool loadMemory(const char *path, const void *data, size_t size);
+  bool saveText(const char *path);
+  bool saveBinary(const char *path);
+  void build(World *world);
+  float getLeft();
+  float getRight();
+  float getTop();
+  float getBottom();
+  float getCannonX();
+  float getCannonY();
+  int getBlockCount();
+  int getTargetCount();
+  const LevelBlock& getBlock(int k);
+  const LevelTarget& getTarget(int k);
+  const char* getError();
+private:
+  bool fail(const char *path, const char *message, int line = 0);
+  bool readText(FILE *file, const char *path);
+  bool checkTargets(const char *path);
+  void unmap();
+  LevelHeader header;
+  const LevelBlock *blocks;
+  const LevelTarget *targets;
+  std::vector<LevelBlock> textBlocks;
+  std::vector<LevelTarget> textTargets;
+  void *mapping;
+  size_t mappingSize;
+  std::string error;
+};
+
+#endif
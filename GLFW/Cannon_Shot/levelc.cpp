@@ -0,0 +1,28 @@
+#include <cstdio>
+#include <cstring>
+
+#include "level.h"
+
+/* Level compiler. Reads a level in either form and writes the binary
+ * form, or the text form back out with -t. */
+int main(int argc, char **argv){
+  bool toText = argc == 4 && strcmp(argv[1], "-t") == 0;
+  if(argc != 3 && !toText){
+    fprintf(stderr, "usage: levelc [-t] <in> <out>\n");
+    return 1;
+  }
+  const char *in = argv[argc - 2];
+  const char *out = argv[argc - 1];
+  Level level;
+  if(!level.load(in)){
+    fprintf(stderr, "%s\n", level.getError());
+    return 1;
+  }
+  bool ok = toText ? level.saveText(out) : level.saveBinary(out);
+  if(!ok){
+    fprintf(stderr, "%s\n", level.getError());
+    return 1;
+  }
+  printf("%s: %d blocks, %d targets\n", out, level.getBlockCount(), level.getTargetCount());
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <cstring>
+
+#include <glad/glad.h>
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "offscreen.h"
+
+using namespace std;
+
+OffscreenContext::OffscreenContext(){
+  this->display = EGL_NO_DISPLAY;
+  this->context = EGL_NO_CONTEXT;
+  this->framebuffer = 0;
+  this->renderbuffers[0] = 0;
+  this->renderbuffers[1] = 0;
+  this->width = 0;
+  this->height = 0;
+}
+
+OffscreenContext::~OffscreenContext(){
+  if(framebuffer != 0){
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(2, renderbuffers);
+  }
+  if(display != EGL_NO_DISPLAY){
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context != EGL_NO_CONTEXT)
+      eglDestroyContext(display, context);
+    eglTerminate(display);
+  }
+}
+
+bool OffscreenContext::fail(const char *message){
+  error = message;
+  return false;
+}
+
+bool OffscreenContext::create(int width, int height){
+  this->width = width;
+  this->height = height;
+
+  // Surfaceless first, it works with no X or Wayland at all
+  const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if(getPlatformDisplay != NULL && extensions != NULL && strstr(extensions, "EGL_MESA_platform_surfaceless") != NULL)
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if(display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  EGLint major, minor;
+  if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)){
+    display = EGL_NO_DISPLAY;
+    return fail("could not open an EGL display");
+  }
+  if(!eglBindAPI(EGL_OPENGL_API))
+    return fail("EGL has no desktop OpenGL");
+
+  // the default surface type is window, which a surfaceless display has none of
+  EGLint configAttributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint configs = 0;
+  if(!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs == 0)
+    return fail("no EGL config can render OpenGL");
+  EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+  if(context == EGL_NO_CONTEXT)
+    return fail("could not create an OpenGL 3.3 core context");
+  if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    return fail("could not make the context current without a surface");
+  if(!gladLoadGLLoader((GLADloadproc) eglGetProcAddress))
+    return fail("could not load the OpenGL functions");
+
+  // Everything draws into this instead of a window's back buffer
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glGenRenderbuffers(2, renderbuffers);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    return fail("offscreen framebuffer is incomplete");
+  glViewport(0, 0, width, height);
+  return true;
+}
+
+/* Binary PPM of the framebuffer, top row first. Waits for the frame
+ * to finish rendering. */
+bool OffscreenContext::savePPM(const char *path){
+  pixels.resize((size_t)width * height * 3);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+  FILE *file = fopen(path, "wb");
+  if(file == NULL)
+    return fail("could not write frame");
+  bool ok = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+  for(int y = height - 1; y >= 0 && ok; y--)
+    ok = fwrite(&pixels[(size_t)y * width * 3], 3, width, file) == (size_t)width;
+  ok = (fclose(file) == 0) && ok;
+  if(!ok)
+    return fail("could not write frame");
+  return true;
+}
+
+int OffscreenContext::getWidth(){
+  return width;
+}
+
+int OffscreenContext::getHeight(){
+  return height;
+}
+
+const char* OffscreenContext::getError(){
+  return error.c_str();
+}
@@ -0,0 +1,33 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <vector>
+#include <string>
+
+/* A GL 3.3 core context with no window, drawing into a framebuffer
+ * object instead of a swap chain. It is made with EGL on the Mesa
+ * surfaceless platform when there is one, so no display server is
+ * needed and software GL such as llvmpipe is enough. create() also
+ * loads the GL entry points through glad. */
+class OffscreenContext{
+public:
+  OffscreenContext();
+  ~OffscreenContext();
+  bool create(int width, int height);
+  bool savePPM(const char *path);
+  int getWidth();
+  int getHeight();
+  const char* getError();
+private:
+  bool fail(const char *message);
+  void *display;  // EGLDisplay and EGLContext, kept opaque so the
+  void *context;  // EGL headers stay out of the game
+  unsigned int framebuffer;
+  unsigned int renderbuffers[2];
+  int width;
+  int height;
+  std::vector<unsigned char> pixels;
+  std::string error;
+};
+
+#endif
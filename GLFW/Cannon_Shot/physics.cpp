@@ -0,0 +1,1190 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+#include "physics.h"
+#include "profiler.h"
+
+using namespace std;
+
+const float Item::GRAVITY = 75.0f;
+const float Item::BOUNCE_COF = 0.4f;
+const float Item::FRICTION_COF = 0.1f;
+const float Item::OBS_BOUNCE_COF = 0.6f;
+const float Item::WALL_BOUNCE_COF = 0.2f;
+
+// How far past the time of impact a swept bomb is placed, so the
+// strict overlap tests of the discrete pass see the contact
+static const float CCD_PENETRATION = 0.01f;
+
+Item::Item(BodyStore *bodies, Bounds *bounds, float mass, float x, float y, float ux, float uy, float radius){
+  this->bodies = bodies;
+  this->bounds = bounds;
+  this->id = bodies->add(mass, x, y, ux, uy, radius);
+  this->collisionFlag = false;
+}
+
+Item::~Item(){
+}
+
+bool Item::checkCollisionGround(){
+  return (bodies->y[id] - bounds->bottom <= bodies->radius[id]);
+}
+
+void Item::setTime(float time){
+  bodies->time[id] = time;
+}
+
+float Item::getPositionX(){
+  return bodies->x[id];
+}
+
+float Item::getPositionY(){
+  return bodies->y[id];
+}
+
+float Item::getPrevPositionX(){
+  return bodies->prevX[id];
+}
+
+float Item::getPrevPositionY(){
+  return bodies->prevY[id];
+}
+
+float Item::getSpeedX(){
+  return bodies->ux[id];
+}
+
+float Item::getSpeedY(){
+  return bodies->uy[id];
+}
+
+float Item::getRadius(){
+  return bodies->radius[id];
+}
+
+float Item::getMass(){
+  return bodies->mass[id];
+}
+
+bool Item::getCollisionFlag(){
+  return collisionFlag;
+}
+
+bool Item::isAsleep(){
+  return bodies->awake[id] <= 0.0f;
+}
+
+/* A body that is not present takes no part in any collision */
+void Item::setPresent(bool value){
+  bodies->present[id] = value ? 1.0f : 0.0f;
+}
+
+bool Item::isPresent(){
+  return bodies->present[id] > 0.0f;
+}
+
+int Item::getId(){
+  return id;
+}
+
+bool Item::checkStoppage(){
+  float tx = bodies->x[id] - bodies->prevX[id];
+  float ty = bodies->y[id] - bodies->prevY[id];
+  if(tx < 0.0f)tx *= -1.0f;
+  if(ty < 0.0f)ty *= -1.0f;
+  if(tx < 0.01f && ty < 0.01f)
+    {
+      //cout<<"returned TRUE"<<endl;
+      return true;
+    }
+  else return false;
+}
+
+/* Moves the body without a trail, the previous position follows */
+void Item::setPosition(float x, float y){
+  bodies->x[id] = x;
+  bodies->y[id] = y;
+  bodies->prevX[id] = x;
+  bodies->prevY[id] = y;
+}
+
+void Item::setSpeed(float ux, float uy){
+  bodies->ux[id] = ux;
+  bodies->uy[id] = uy;
+}
+
+Bomb::Bomb(BodyStore *bodies, Bounds *bounds, float cx, float cy, float speedX, float speedY)
+  : Item(bodies, bounds, 5.0f, cx, cy, speedX, speedY, 2.0f)
+{
+  this->collisionFlag = true;
+  setDynamic(false);
+}
+
+/* Called after a step the bomb was integrated in */
+void Bomb::checkFlight(){
+  if(dynamic){
+    float xrp = bodies->x[id] - bodies->radius[id];
+
+    if(xrp > bounds->right || xrp < bounds->left || this->checkStoppage())
+    {
+      this->setDynamic(false);
+    }
+
+  }
+}
+
+void Bomb::setDynamic(bool value){
+  this->dynamic = value;
+  bodies->active[id] = value ? 1.0f : 0.0f;
+  bodies->awake[id] = 1.0f;
+  bodies->restTicks[id] = 0;
+}
+
+bool Bomb::getDynamic(){
+  return this->dynamic;
+}
+
+Block::Block(float x, float y, float width, float height, bool dynamic){
+  this->x = x;
+  this->prevX = x;
+  this->y = y;
+  this->width = width;
+  this->height = height;
+  this->halfWidth = width/2.0f;
+  this->halfHeight = height/2.0f;
+  this->dynamic = dynamic;
+  this->time = 0.0f;
+  if(dynamic){
+  	this->leftBound = x - 10.0f;
+  	this->rightBound = x + 10.0f;
+  	this->speed = 5.0f;
+  }
+  else{
+  	this->leftBound = x;
+  	this->rightBound = x;
+  	this->speed = 0.0f;
+  }
+}
+
+float Block::getPositionY(){
+  return y;
+}
+float Block::getPositionX(){
+  return x;
+}
+float Block::getPrevPositionX(){
+  return prevX;
+}
+float Block::getHeight(){
+  return height;
+}
+float Block::getWidth(){
+  return width;
+}
+
+float Block::getMinX(){
+  return x - halfWidth;
+}
+
+float Block::getMaxX(){
+  return x + halfWidth;
+}
+
+float Block::getMinY(){
+  return y - halfHeight;
+}
+
+float Block::getMaxY(){
+  return y + halfHeight;
+}
+
+void Block::applyForces(float timeInstance){
+	if(dynamic){
+		time += timeInstance;
+		prevX = x;
+		x += speed* timeInstance;
+		if(x < leftBound || x > rightBound){
+			speed *= -1.0f;
+		}
+	}
+}
+
+bool Block::isDynamic(){
+	return dynamic;
+}
+
+float Block::getSpeed(){
+	return speed;
+}
+
+float Block::getLeftBound(){
+	return leftBound;
+}
+
+float Block::getRightBound(){
+	return rightBound;
+}
+
+BlockState Block::getState(){
+	BlockState state;
+	state.x = x;
+	state.y = y;
+	state.prevX = prevX;
+	state.speed = speed;
+	state.time = time;
+	return state;
+}
+
+void Block::setState(const BlockState &state){
+	x = state.x;
+	y = state.y;
+	prevX = state.prevX;
+	speed = state.speed;
+	time = state.time;
+}
+
+Target::Target(BodyStore *bodies, Bounds *bounds, Block* pillar)
+  :Item(bodies, bounds, 3.0f, pillar->getPositionX(), pillar->getPositionY() + pillar->getHeight()/2.0f + 2.5f, pillar->getSpeed(), 0.0f, 2.5f)
+{
+  this->pillar = pillar;
+  this->collisionFlag = false;
+}
+
+/* A target resting on its pillar does not feel gravity */
+void Target::updateSupport(){
+  bodies->support[id] = isInContact() ? 1.0f : 0.0f;
+}
+
+/* Called after each step, keeps a target riding a moving pillar on it */
+void Target::followPillar(){
+  if(pillar->isDynamic() && isInContact()){
+  	float x = bodies->x[id];
+  	if(x < pillar->getLeftBound() || x > pillar->getRightBound()){
+  			bodies->ux[id] *= -1.0f;
+  		}
+  	}
+}
+
+bool Target::isInContact(){
+  float lb = pillar->getPositionX() - pillar->getWidth()/2.0f;
+  float rb = pillar->getPositionX() + pillar->getWidth()/2.0f;
+  float ub = pillar->getPositionY() + pillar->getHeight()/2.0f + bodies->radius[id] + 1.0f;
+  float x = bodies->x[id];
+  if(x >= lb && x <=rb && bodies->y[id] <= ub)
+  	return true;
+  else return false;
+}
+
+Block* Target::getPillar(){
+  return pillar;
+}
+
+bool checkCollisionItem(Item &first, Item &second, bool &flag){
+  BodyStore &bodies = *first.bodies;
+  int i = first.id;
+  int j = second.id;
+  float x12 = bodies.x[i] - bodies.x[j];
+  float y12 = bodies.y[i] - bodies.y[j];
+  float dist = x12*x12 + y12*y12 - 5.0f;
+  float r12 = bodies.radius[i] + bodies.radius[j];
+  r12 = r12 * r12;
+  if(dist <= r12 && flag)
+    {
+      flag = false;
+      return true;
+    }
+  else
+    {
+      return false;
+    }
+
+}
+
+void simulateCollisionItem(Item &first, Item &second){
+  BodyStore &bodies = *first.bodies;
+  int i = first.id;
+  int j = second.id;
+
+  //Vector pointing in direction of collision
+  float cx = bodies.x[i] - bodies.x[j];
+  float cy = bodies.y[i] - bodies.y[j];
+
+  //Distance of the above vector
+  float distance = (float)sqrt(cx*cx + cy*cy);
+
+  //Unit vector in direction of collision
+  float unitX, unitY;
+  if(distance == 0.0f){
+    unitX = 1.0f;
+    unitY = 0.0f;
+  }
+  else{
+    unitX = cx/distance;
+    unitY = cy/distance;
+  }
+
+  // Component of velocity of Item first,second in
+  // in direction of collision
+  float firstInitComp = bodies.ux[i] * unitX + bodies.uy[i] * unitY;
+  float secondInitComp = bodies.ux[j] * unitX + bodies.uy[j] * unitY;
+
+  float firstFinalComp = (firstInitComp*(bodies.mass[i] - bodies.mass[j]) + 2*bodies.mass[j]*secondInitComp)/(bodies.mass[i] + bodies.mass[j]);
+  float secondFinalComp = (secondInitComp*(bodies.mass[j] - bodies.mass[i]) + 2*bodies.mass[i]*firstInitComp)/(bodies.mass[i] + bodies.mass[j]);
+
+  float firstChange = firstFinalComp - firstInitComp;
+  float secondChange = secondFinalComp - secondInitComp;
+
+  bodies.ux[i] += firstChange * unitX;
+  bodies.uy[i] += firstChange * unitY;
+
+  bodies.ux[j] += secondChange * unitX;
+  bodies.uy[j] += secondChange * unitY;
+
+  float magFirstChangeX = (firstChange * unitX) > 0.0f ? (firstChange * unitX) : (-1.0f * firstChange * unitX);
+  float magFirstChangeY = (firstChange * unitY) > 0.0f ? (firstChange * unitY) : (-1.0f * firstChange * unitY);
+
+  float magSecondChangeX = (secondChange * unitX) > 0.0f ? (secondChange * unitX) : (-1.0f * secondChange * unitX);
+  float magSecondChangeY = (secondChange * unitY) > 0.0f ? (secondChange * unitY) : (-1.0f * secondChange * unitY);
+
+  if(true){
+  	bodies.x[i] += (firstChange * unitX)/magFirstChangeX * 1.0f;
+  	bodies.y[i] += (firstChange * unitY)/magSecondChangeX * 1.0f;
+  	bodies.x[j] += (secondChange * unitX)/magSecondChangeX * 1.0f;
+  	bodies.y[j] += (secondChange * unitY)/magSecondChangeY * 1.0f;
+  }
+
+}
+
+bool checkCollisionBlock(Item& ball, Block& obs)
+{
+  BodyStore &bodies = *ball.bodies;
+  int i = ball.id;
+  float obsLeftBound = obs.x - obs.halfWidth - bodies.radius[i];
+  float obsRightBound = obs.x + obs.halfWidth + bodies.radius[i];
+  float obsTopBound = obs.y + obs.halfHeight + bodies.radius[i];
+  float obsBottomBound = obs.y - obs.halfHeight - bodies.radius[i];
+  if(bodies.x[i] > obsLeftBound && bodies.x[i] < obsRightBound && bodies.y[i] < obsTopBound && bodies.y[i] > obsBottomBound){
+    return true;
+  }
+  else return false;
+}
+
+void simulateCollisionBlock(Item& ball, Block &obs){
+  BodyStore &bodies = *ball.bodies;
+  int i = ball.id;
+  float obsLeftBound = obs.x - obs.halfWidth - bodies.radius[i];
+  float obsRightBound = obs.x + obs.halfWidth + bodies.radius[i];
+  float obsTopBound = obs.y + obs.halfHeight + bodies.radius[i];
+  float obsBottomBound = obs.y - obs.halfHeight - bodies.radius[i];
+  float obsTop = obs.y + obs.halfHeight;
+  float obsBottom = obs.y - obs.halfHeight;
+  if(bodies.y[i] < obsTop && bodies.y[i] > obsBottom){
+    bodies.ux[i] = -1.0f * Item::OBS_BOUNCE_COF * bodies.ux[i];
+    if(bodies.x[i] < obs.x)
+      bodies.x[i] = obsLeftBound - 1.0f;
+    else
+      bodies.x[i] = obsRightBound + 1.0f;
+
+  }
+  else {
+  	bodies.uy[i] = -1.0f * Item::OBS_BOUNCE_COF * bodies.uy[i];
+  	if(bodies.y[i] > obs.y)
+  		bodies.y[i] = obsTopBound + 1.0f;
+  	else
+  		bodies.y[i] = obsBottomBound - 1.0f;
+  }
+}
+
+/* Earliest time in [0,1] at which a circle moving from (x0,y0) to
+ * (x1,y1) enters the block grown by its radius, which is the region
+ * checkCollisionBlock tests the centre against. Returns false if it
+ * never does or already starts inside. */
+bool sweepCircleBlock(float x0, float y0, float x1, float y1, float radius, Block &obs, float &toi){
+  float minX = obs.x - obs.halfWidth - radius;
+  float maxX = obs.x + obs.halfWidth + radius;
+  float minY = obs.y - obs.halfHeight - radius;
+  float maxY = obs.y + obs.halfHeight + radius;
+  if(x0 > minX && x0 < maxX && y0 > minY && y0 < maxY)
+    return false;
+  float dx = x1 - x0;
+  float dy = y1 - y0;
+  float tEnter = 0.0f;
+  float tExit = 1.0f;
+  if(dx == 0.0f){
+    if(x0 <= minX || x0 >= maxX)
+      return false;
+  }
+  else{
+    float t1 = (minX - x0) / dx;
+    float t2 = (maxX - x0) / dx;
+    if(t1 > t2)swap(t1, t2);
+    tEnter = max(tEnter, t1);
+    tExit = min(tExit, t2);
+  }
+  if(dy == 0.0f){
+    if(y0 <= minY || y0 >= maxY)
+      return false;
+  }
+  else{
+    float t1 = (minY - y0) / dy;
+    float t2 = (maxY - y0) / dy;
+    if(t1 > t2)swap(t1, t2);
+    tEnter = max(tEnter, t1);
+    tExit = min(tExit, t2);
+  }
+  if(tEnter >= tExit)
+    return false;
+  toi = tEnter;
+  return true;
+}
+
+/* Earliest time in [0,1] at which two moving centres come within
+ * reach of each other. Returns false if they never do, already are,
+ * or are moving apart. */
+bool sweepCircleCircle(float ax0, float ay0, float ax1, float ay1, float bx0, float by0, float bx1, float by1, float reach, float &toi){
+  float sx = ax0 - bx0;
+  float sy = ay0 - by0;
+  float dx = (ax1 - ax0) - (bx1 - bx0);
+  float dy = (ay1 - ay0) - (by1 - by0);
+  float c = sx*sx + sy*sy - reach*reach;
+  if(c <= 0.0f)
+    return false;
+  float b = 2.0f * (sx*dx + sy*dy);
+  if(b >= 0.0f)
+    return false;
+  float a = dx*dx + dy*dy;
+  float disc = b*b - 4.0f*a*c;
+  if(disc < 0.0f)
+    return false;
+  float t = (-b - sqrtf(disc)) / (2.0f * a);
+  if(t > 1.0f)
+    return false;
+  toi = t;
+  return true;
+}
+
+bool checkCollisionWall(Item& ball){
+	BodyStore &bodies = *ball.bodies;
+	int i = ball.id;
+	float ballRightSide = bodies.x[i] + bodies.radius[i];
+	float ballLeftSide = bodies.x[i] - bodies.radius[i];
+	float ballTopSide = bodies.y[i] + bodies.radius[i];
+	if(ballRightSide > ball.bounds->right || ballLeftSide < ball.bounds->left || ballTopSide > ball.bounds->top){
+		return true;
+	}
+	else return false;
+}
+
+void simulateCollisionWall(Item& ball){
+	BodyStore &bodies = *ball.bodies;
+	int i = ball.id;
+	float ballRightSide = bodies.x[i] + bodies.radius[i];
+	float ballLeftSide = bodies.x[i] - bodies.radius[i];
+	float ballTopSide = bodies.y[i] + bodies.radius[i];
+	if(ballRightSide > ball.bounds->right || ballLeftSide < ball.bounds->left){
+		bodies.ux[i] = -1.0f * Item::WALL_BOUNCE_COF * bodies.ux[i];
+		if(ballRightSide > ball.bounds->right)
+			bodies.x[i] -= (bodies.radius[i] + 0.01f);
+		if(ballLeftSide < ball.bounds->left)
+			bodies.x[i] += (bodies.radius[i] + 0.01f);
+	}
+	if(ballTopSide > ball.bounds->top){
+		bodies.uy[i] = -1.0f * Item::WALL_BOUNCE_COF * bodies.uy[i];
+		bodies.y[i] -= (bodies.radius[i] + 0.01f);
+	}
+}
+
+World::World(float left, float right, float top, float bottom){
+  setBounds(left, right, top, bottom);
+  this->integrator = bestIntegrator();
+  this->blockTreesDirty = true;
+  this->continuousCollision = true;
+  this->sleeping = true;
+  this->sleepTicks = 30;
+  this->score = 0;
+  this->targetCount = 0;
+}
+
+World::~World(){
+  for(int i = 0; i < movableList.size(); i++)
+    delete movableList[i];
+  for(int i = 0; i < obstacleList.size(); i++)
+    delete obstacleList[i];
+}
+
+Block* World::addBlock(float x, float y, float width, float height, bool dynamic){
+  Block *block = new Block(x, y, width, height, dynamic);
+  obstacleList.push_back(block);
+  blockTreesDirty = true;
+  return block;
+}
+
+Target* World::addTarget(Block* pillar){
+  Target *target = new Target(&bodies, &bounds, pillar);
+  movableList.push_back(target);
+  targetList.push_back(target);
+  targetCount++;
+  return target;
+}
+
+Bomb* World::addBomb(float cx, float cy, float ux, float uy){
+  Bomb *bomb = new Bomb(&bodies, &bounds, cx, cy, ux, uy);
+  movableList.push_back(bomb);
+  bombList.push_back(bomb);
+  return bomb;
+}
+
+/* Room for that many more blocks and bodies, so a big level loads
+ * without the lists growing over and over */
+void World::reserve(int blockCount, int bodyCount){
+  obstacleList.reserve(obstacleList.size() + blockCount);
+  movableList.reserve(movableList.size() + bodyCount);
+  targetList.reserve(targetList.size() + bodyCount);
+  bodies.reserve(bodies.size() + bodyCount);
+}
+
+/* Blocks move first so that targets see where their pillar is this tick,
+ * then every body is integrated in one batch over the BodyStore */
+void World::step(float timeInstance){
+  PROFILE_ZONE("World::step");
+  {
+    PROFILE_ZONE("applyForces");
+    for(int i = 0; i < obstacleList.size(); i++)
+      obstacleList[i]->applyForces(timeInstance);
+  }
+  for(int i = 0; i < targetList.size(); i++)
+    if(!targetList[i]->isAsleep())
+      targetList[i]->updateSupport();
+  {
+    PROFILE_ZONE("integrateBodies");
+    integrateBodies(bodies, timeInstance, bounds.bottom, integrator);
+  }
+  updateBlockTrees();
+  if(continuousCollision)
+    sweepFastBombs();
+  for(int i = 0; i < bombList.size(); i++)
+    bombList[i]->checkFlight();
+  for(int i = 0; i < targetList.size(); i++)
+    if(!targetList[i]->isAsleep())
+      targetList[i]->followPillar();
+  handleCollisionsItem();
+  handleCollisionsBlock();
+  handleCollisionsWall();
+  if(sleeping)
+    updateSleep();
+}
+
+void World::setIntegrator(Integrator kind){
+  this->integrator = kind;
+}
+
+Integrator World::getIntegrator(){
+  return integrator;
+}
+
+void World::setContinuousCollision(bool value){
+  this->continuousCollision = value;
+}
+
+bool World::getContinuousCollision(){
+  return continuousCollision;
+}
+
+void World::setSleeping(bool value){
+  this->sleeping = value;
+  if(!value)
+    for(int i = 0; i < bodies.size(); i++)
+      wakeBody(i);
+}
+
+void World::setSleepTicks(int ticks){
+  this->sleepTicks = ticks;
+}
+
+int World::getSleepingCount(){
+  int count = 0;
+  for(int i = 0; i < bodies.size(); i++)
+    if(bodies.awake[i] <= 0.0f)
+      count++;
+  return count;
+}
+
+BodyStore* World::getBodies(){
+  return &bodies;
+}
+
+SpatialGrid* World::getGrid(){
+  return &grid;
+}
+
+/* The ground may have moved, so nothing can stay asleep on it */
+void World::setBounds(float left, float right, float top, float bottom){
+  bounds.left = left;
+  bounds.right = right;
+  bounds.top = top;
+  bounds.bottom = bottom;
+  for(int i = 0; i < bodies.size(); i++)
+    wakeBody(i);
+}
+
+Bounds* World::getBounds(){
+  return &bounds;
+}
+
+int World::getScore(){
+  return score;
+}
+
+int World::getTargetCount(){
+  return targetCount;
+}
+
+bool World::isCleared(){
+  return score == targetCount;
+}
+
+std::vector<Item*>& World::getMovableList(){
+  return movableList;
+}
+
+std::vector<Block*>& World::getObstacleList(){
+  return obstacleList;
+}
+
+std::vector<Target*>& World::getTargetList(){
+  return targetList;
+}
+
+template<class T>
+static uint64_t hashVector(uint64_t hash, const std::vector<T> &values){
+  if(values.empty())
+    return hash;
+  return hashBytes(hash, &values[0], values.size() * sizeof(T));
+}
+
+/* Everything a step reads or writes, bit for bit, so two worlds that
+ * hash the same will go on to do the same. Bounds and settings count
+ * too as they change what a step does. The integrator does not, every
+ * kind gives the same bits. */
+uint64_t World::stateHash(){
+  uint64_t hash = HASH_SEED;
+  hash = hashBytes(hash, &bounds, sizeof(bounds));
+  hash = hashVector(hash, bodies.x);
+  hash = hashVector(hash, bodies.y);
+  hash = hashVector(hash, bodies.prevX);
+  hash = hashVector(hash, bodies.prevY);
+  hash = hashVector(hash, bodies.ux);
+  hash = hashVector(hash, bodies.uy);
+  hash = hashVector(hash, bodies.ax);
+  hash = hashVector(hash, bodies.ay);
+  hash = hashVector(hash, bodies.time);
+  hash = hashVector(hash, bodies.support);
+  hash = hashVector(hash, bodies.active);
+  hash = hashVector(hash, bodies.awake);
+  hash = hashVector(hash, bodies.restTicks);
+  hash = hashVector(hash, bodies.present);
+  for(int i = 0; i < obstacleList.size(); i++){
+    float block[4] = {obstacleList[i]->getPositionX(), obstacleList[i]->getPositionY(),
+                      obstacleList[i]->getPrevPositionX(), obstacleList[i]->getSpeed()};
+    hash = hashBytes(hash, block, sizeof(block));
+  }
+  for(int i = 0; i < movableList.size(); i++){
+    unsigned char flag = movableList[i]->collisionFlag;
+    hash = hashBytes(hash, &flag, 1);
+  }
+  for(int i = 0; i < bombList.size(); i++){
+    unsigned char dynamic = bombList[i]->getDynamic();
+    hash = hashBytes(hash, &dynamic, 1);
+  }
+  int settings[4] = {score, continuousCollision, sleeping, sleepTicks};
+  return hashBytes(hash, settings, sizeof(settings));
+}
+
+/* Every BodyStore array, in the order a saved state holds them */
+static void bodyArrays(BodyStore &bodies, std::vector<float>* arrays[15]){
+  std::vector<float>* list[15] = {&bodies.x, &bodies.y, &bodies.prevX, &bodies.prevY,
+                                  &bodies.ux, &bodies.uy, &bodies.ax, &bodies.ay,
+                                  &bodies.time, &bodies.mass, &bodies.radius, &bodies.support,
+                                  &bodies.active, &bodies.awake, &bodies.present};
+  for(int k = 0; k < 15; k++)
+    arrays[k] = list[k];
+}
+
+/* Bytes saveState() writes, the same for as long as no body or block
+ * is added */
+size_t World::getStateSize(){
+  size_t n = bodies.size();
+  return sizeof(WorldStateHeader) + n * (15 * sizeof(float) + sizeof(int))
+       + obstacleList.size() * sizeof(BlockState) + n + bombList.size();
+}
+
+/* Copies the world's whole changing state out as plain bytes. Only
+ * loadState() on this same world, or one built the same way, reads
+ * them. The grid and block trees are left out, every step rebuilds
+ * or refits them before use. */
+void World::saveState(void *out){
+  unsigned char *p = (unsigned char*)out;
+  WorldStateHeader header;
+  header.bodyCount = bodies.size();
+  header.blockCount = obstacleList.size();
+  header.bombCount = bombList.size();
+  header.score = score;
+  header.bounds = bounds;
+  memcpy(p, &header, sizeof(header));
+  p += sizeof(header);
+  size_t n = bodies.size();
+  std::vector<float>* arrays[15];
+  bodyArrays(bodies, arrays);
+  if(n > 0){
+    for(int k = 0; k < 15; k++){
+      memcpy(p, &(*arrays[k])[0], n * sizeof(float));
+      p += n * sizeof(float);
+    }
+    memcpy(p, &bodies.restTicks[0], n * sizeof(int));
+    p += n * sizeof(int);
+  }
+  for(int j = 0; j < obstacleList.size(); j++){
+    BlockState state = obstacleList[j]->getState();
+    memcpy(p, &state, sizeof(state));
+    p += sizeof(state);
+  }
+  for(int i = 0; i < n; i++)
+    *p++ = movableList[i]->collisionFlag;
+  for(int b = 0; b < bombList.size(); b++)
+    *p++ = bombList[b]->getDynamic();
+}
+
+/* Puts back what saveState() wrote. Returns false, changing nothing,
+ * when the state has other counts of bodies, blocks or bombs. */
+bool World::loadState(const void *in){
+  const unsigned char *p = (const unsigned char*)in;
+  WorldStateHeader header;
+  memcpy(&header, p, sizeof(header));
+  p += sizeof(header);
+  if(header.bodyCount != bodies.size() || header.blockCount != obstacleList.size() || header.bombCount != bombList.size())
+    return false;
+  score = header.score;
+  bounds = header.bounds;
+  size_t n = bodies.size();
+  std::vector<float>* arrays[15];
+  bodyArrays(bodies, arrays);
+  if(n > 0){
+    for(int k = 0; k < 15; k++){
+      memcpy(&(*arrays[k])[0], p, n * sizeof(float));
+      p += n * sizeof(float);
+    }
+    memcpy(&bodies.restTicks[0], p, n * sizeof(int));
+    p += n * sizeof(int);
+  }
+  for(int j = 0; j < obstacleList.size(); j++){
+    BlockState state;
+    memcpy(&state, p, sizeof(state));
+    p += sizeof(state);
+    obstacleList[j]->setState(state);
+  }
+  for(int i = 0; i < n; i++)
+    movableList[i]->collisionFlag = *p++ != 0;
+  for(int b = 0; b < bombList.size(); b++)
+    bombList[b]->dynamic = *p++ != 0;  // setDynamic() would wake it
+  return true;
+}
+
+StateArena::StateArena(size_t slotSize, int slots){
+  this->slotSize = slotSize;
+  this->slots = slots;
+  this->memory = new unsigned char[slotSize * slots];
+}
+
+StateArena::~StateArena(){
+  delete[] memory;
+}
+
+void* StateArena::getSlot(int k){
+  return memory + slotSize * k;
+}
+
+size_t StateArena::getSlotSize(){
+  return slotSize;
+}
+
+int StateArena::getSlotCount(){
+  return slots;
+}
+
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size){
+  const unsigned char *bytes = (const unsigned char*)data;
+  for(size_t i = 0; i < size; i++){
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static unsigned long long pairKey(int first, int second){
+  return ((unsigned long long)first << 32) | (unsigned int)second;
+}
+
+static bool pairBefore(const CandidatePair &pair, unsigned long long key){
+  return pairKey(pair.first, pair.second) < key;
+}
+
+/* Body ids match positions in movableList, so the grid's pairs come
+ * out in the same order the old all-pairs loop visited them. The grid
+ * only pads each body for the first pushes simulateCollisionItem makes
+ * while the pairs are resolved, and its y push has no bound. A body
+ * pushed past the padding is looked up again by recheckPushedBody(), and
+ * the pairs that finds past the current one join the sweep in order, so
+ * no pair the old loop would have resolved is missed. */
+void World::handleCollisionsItem(){
+  PROFILE_ZONE("handleCollisionsItem");
+  bool flag = true;
+  grid.rebuild(bodies);
+  std::vector<CandidatePair> &pairs = grid.getPairs();
+  // A pair the grid left out was 2 * padding apart per axis and checks
+  // positive at sqrt(5) apart, each body may close half of the rest
+  float escapeDistance = grid.getPadding() - 1.12f;
+  anchorX.assign(bodies.x.begin(), bodies.x.end());
+  anchorY.assign(bodies.y.begin(), bodies.y.end());
+  escaped.clear();
+  extraPairs.clear();
+  int next = 0;
+  bool haveLast = false;
+  unsigned long long last = 0;
+  while(true){
+    unsigned long long key;
+    if(!extraPairs.empty() && (next >= pairs.size() || extraPairs.front() < pairKey(pairs[next].first, pairs[next].second))){
+      key = extraPairs.front();
+      pop_heap(extraPairs.begin(), extraPairs.end(), greater<unsigned long long>());
+      extraPairs.pop_back();
+      // a pair can be queued by both of its bodies
+      if(haveLast && key == last)
+        continue;
+    }
+    else if(next < pairs.size()){
+      key = pairKey(pairs[next].first, pairs[next].second);
+      next++;
+    }
+    else
+      break;
+    haveLast = true;
+    last = key;
+    int i = (int)(key >> 32);
+    int j = (int)(key & 0xffffffffu);
+    flag = true;
+    if(checkCollisionItem(*movableList[i], *movableList[j], flag)){
+    	if(movableList[i]->collisionFlag == false){
+    		movableList[i]->collisionFlag = true;
+    		score++;
+    	}
+    	if(movableList[j]->collisionFlag == false){
+    		movableList[j]->collisionFlag = true;
+    		score++;
+    	}
+    	simulateCollisionItem(*movableList[i], *movableList[j]);
+    	wakeBody(i);
+    	wakeBody(j);
+    	recheckPushedBody(i, key, escapeDistance);
+    	recheckPushedBody(j, key, escapeDistance);
+    }
+  }
+
+}
+
+/* A body that moved further than escapeDistance from where the grid
+ * last saw it is looked up again where it is now. Bodies the grid
+ * still has in place are found through their padded cells, the others
+ * that moved that far by where they were last looked up. Every pair after current
+ * that the grid did not give already is queued. */
+void World::recheckPushedBody(int id, unsigned long long current, float escapeDistance){
+  if(fabsf(bodies.x[id] - anchorX[id]) <= escapeDistance && fabsf(bodies.y[id] - anchorY[id]) <= escapeDistance)
+    return;
+  anchorX[id] = bodies.x[id];
+  anchorY[id] = bodies.y[id];
+  float padding = grid.getPadding();
+  float reach = bodies.radius[id] + padding;
+  bodyHits.clear();
+  grid.query(bodies.x[id] - reach, bodies.y[id] - reach, bodies.x[id] + reach, bodies.y[id] + reach, bodyHits);
+  // the same bound between two anchors, both bodies may still move
+  // escapeDistance before they are looked up again
+  bool listed = false;
+  for(int k = 0; k < escaped.size(); k++){
+    int other = escaped[k];
+    listed = listed || other == id;
+    float apart = bodies.radius[id] + bodies.radius[other] + 2.0f * padding;
+    if(fabsf(anchorX[other] - anchorX[id]) <= apart && fabsf(anchorY[other] - anchorY[id]) <= apart)
+      bodyHits.push_back(other);
+  }
+  if(!listed)
+    escaped.push_back(id);
+  std::vector<CandidatePair> &pairs = grid.getPairs();
+  for(int k = 0; k < bodyHits.size(); k++){
+    int other = bodyHits[k];
+    if(other == id)
+      continue;
+    unsigned long long key = pairKey(min(id, other), max(id, other));
+    if(key <= current)
+      continue;
+    std::vector<CandidatePair>::iterator found = lower_bound(pairs.begin(), pairs.end(), key, pairBefore);
+    if(found != pairs.end() && pairKey(found->first, found->second) == key)
+      continue;
+    extraPairs.push_back(key);
+    push_heap(extraPairs.begin(), extraPairs.end(), greater<unsigned long long>());
+  }
+}
+
+/* Static blocks never move, so their tree is only rebuilt when a
+ * block is added. Moving blocks get a tree of their own to refit. */
+void World::rebuildBlockTrees(){
+  std::vector<Block*> staticBlocks, dynamicBlocks;
+  std::vector<int> staticIndices, dynamicIndices;
+  for(int j = 0; j < obstacleList.size(); j++){
+    if(obstacleList[j]->isDynamic()){
+      dynamicBlocks.push_back(obstacleList[j]);
+      dynamicIndices.push_back(j);
+    }
+    else{
+      staticBlocks.push_back(obstacleList[j]);
+      staticIndices.push_back(j);
+    }
+  }
+  staticTree.build(staticBlocks, staticIndices);
+  dynamicTree.build(dynamicBlocks, dynamicIndices);
+  blockTreesDirty = false;
+}
+
+void World::updateBlockTrees(){
+  PROFILE_ZONE("updateBlockTrees");
+  if(blockTreesDirty)
+    rebuildBlockTrees();
+  else
+    dynamicTree.refit();
+}
+
+/* A bomb that moved further than its radius this step could have
+ * skipped through a pillar or a ball between the two discrete tests.
+ * Pull it back along its path to the first thing it touched, the
+ * discrete pass right after then does the bounce. Bodies come from the
+ * grid, bucketed by the boxes they swept this step, so the first fast
+ * bomb pays for one pass over the bodies and every bomb after it only
+ * for the cells along its path. */
+void World::sweepFastBombs(){
+  PROFILE_ZONE("sweepFastBombs");
+  bool indexed = false;
+  for(int b = 0; b < bombList.size(); b++){
+    if(!bombList[b]->getDynamic())
+      continue;
+    int i = bombList[b]->id;
+    float x0 = bodies.prevX[i];
+    float y0 = bodies.prevY[i];
+    float x1 = bodies.x[i];
+    float y1 = bodies.y[i];
+    float r = bodies.radius[i];
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float length2 = dx*dx + dy*dy;
+    if(length2 <= r*r)
+      continue;
+
+    float minX = min(x0, x1) - r;
+    float maxX = max(x0, x1) + r;
+    float minY = min(y0, y1) - r;
+    float maxY = max(y0, y1) + r;
+    float toi = 1.0f;
+    float t;
+    bool hit = false;
+
+    blockHits.clear();
+    staticTree.query(minX, minY, maxX, maxY, blockHits);
+    dynamicTree.query(minX, minY, maxX, maxY, blockHits);
+    for(int k = 0; k < blockHits.size(); k++){
+      if(sweepCircleBlock(x0, y0, x1, y1, r, *obstacleList[blockHits[k]], t) && t < toi){
+        toi = t;
+        hit = true;
+      }
+    }
+
+    if(!indexed){
+      grid.indexSweeps(bodies);
+      indexed = true;
+    }
+    // reach below is at most r + rj + sqrt(5), the grid has the rj
+    bodyHits.clear();
+    float margin = r + 2.25f;
+    grid.query(minX - margin, minY - margin, maxX + margin, maxY + margin, bodyHits);
+    for(int k = 0; k < bodyHits.size(); k++){
+      int j = bodyHits[k];
+      if(j == i || bodies.present[j] <= 0.0f)
+        continue;
+      float rj = bodies.radius[j];
+      float reach = sqrtf((r + rj)*(r + rj) + 5.0f);
+      float jx0 = bodies.prevX[j];
+      float jy0 = bodies.prevY[j];
+      float jx1 = bodies.x[j];
+      float jy1 = bodies.y[j];
+      if(max(jx0, jx1) + reach < minX || min(jx0, jx1) - reach > maxX || max(jy0, jy1) + reach < minY || min(jy0, jy1) - reach > maxY)
+        continue;
+      if(sweepCircleCircle(x0, y0, x1, y1, jx0, jy0, jx1, jy1, reach, t) && t < toi){
+        toi = t;
+        hit = true;
+      }
+    }
+
+    if(hit){
+      t = min(1.0f, toi + CCD_PENETRATION / sqrtf(length2));
+      bodies.x[i] = x0 + dx * t;
+      bodies.y[i] = y0 + dy * t;
+    }
+  }
+}
+
+/* Same result as testing every ball against every block in
+ * obstacleList order. A bounce moves the ball, so after each hit the
+ * trees are asked again for the blocks further down the list. */
+void World::handleCollisionsBlock(){
+  PROFILE_ZONE("handleCollisionsBlock");
+  for(int i = 0; i < movableList.size(); i++){
+    if(bodies.present[i] <= 0.0f)
+      continue;
+    // a resting body can only be hit by a block that moves
+    bool asleep = bodies.awake[i] <= 0.0f;
+    int next = 0;
+    while(true){
+      float x = bodies.x[i];
+      float y = bodies.y[i];
+      float r = bodies.radius[i];
+      blockHits.clear();
+      if(!asleep)
+        staticTree.query(x - r, y - r, x + r, y + r, blockHits);
+      dynamicTree.query(x - r, y - r, x + r, y + r, blockHits);
+      sort(blockHits.begin(), blockHits.end());
+      int hit = -1;
+      for(int k = 0; k < blockHits.size(); k++){
+        int j = blockHits[k];
+        if(j >= next && checkCollisionBlock(*movableList[i], *obstacleList[j])){
+          hit = j;
+          break;
+        }
+      }
+      if(hit < 0)
+        break;
+      if(asleep){
+        wakeBody(i);
+        asleep = false;
+      }
+      simulateCollisionBlock(*movableList[i], *obstacleList[hit]);
+      next = hit + 1;
+    }
+  }
+}
+
+void World::handleCollisionsWall(){
+	PROFILE_ZONE("handleCollisionsWall");
+	for(int i = 0; i < movableList.size(); i++){
+		if(bodies.awake[i] <= 0.0f || bodies.present[i] <= 0.0f)
+			continue;
+		if(checkCollisionWall(*movableList[i])){
+			simulateCollisionWall(*movableList[i]);
+		}
+	}
+}
+
+void World::wakeBody(int id){
+  bodies.awake[id] = 1.0f;
+  bodies.restTicks[id] = 0;
+}
+
+/* Within a unit of a moving block, the same slack Target::isInContact
+ * gives a target sitting on its pillar */
+bool World::touchesMovingBlock(int id){
+  if(dynamicTree.size() == 0)
+    return false;
+  float reach = bodies.radius[id] + 1.0f;
+  blockHits.clear();
+  dynamicTree.query(bodies.x[id] - reach, bodies.y[id] - reach, bodies.x[id] + reach, bodies.y[id] + reach, blockHits);
+  return !blockHits.empty();
+}
+
+/* Same test as Item::checkStoppage, but a body has to pass it for
+ * sleepTicks steps in a row before it is put to sleep. Sleeping
+ * bodies are skipped by the integrator and by the wall pass, and
+ * only pair up with awake ones. Riding or being hit by a moving
+ * block keeps a body awake. */
+void World::updateSleep(){
+  PROFILE_ZONE("updateSleep");
+  for(int i = 0; i < bodies.size(); i++){
+    if(bodies.present[i] <= 0.0f)
+      continue;
+    bool nearMovingBlock = touchesMovingBlock(i);
+    if(bodies.awake[i] <= 0.0f){
+      if(nearMovingBlock)
+        wakeBody(i);
+      continue;
+    }
+    if(bodies.active[i] <= 0.0f || nearMovingBlock){
+      bodies.restTicks[i] = 0;
+      continue;
+    }
+    float tx = fabsf(bodies.x[i] - bodies.prevX[i]);
+    float ty = fabsf(bodies.y[i] - bodies.prevY[i]);
+    if(tx < 0.01f && ty < 0.01f){
+      bodies.restTicks[i]++;
+      if(bodies.restTicks[i] >= sleepTicks)
+        bodies.awake[i] = 0.0f;
+    }
+    else bodies.restTicks[i] = 0;
+  }
+}
+
+BombPool::BombPool(World *world, int capacity, float cx, float cy){
+  this->next = 0;
+  for(int k = 0; k < capacity; k++){
+    Bomb *bomb = world->addBomb(cx, cy, 0.0f, 0.0f);
+    bomb->setPresent(false);
+    bombs.push_back(bomb);
+  }
+}
+
+/* Takes the next bomb that is not in flight, NULL if all of them are */
+Bomb* BombPool::fire(float cx, float cy, float ux, float uy){
+  for(int k = 0; k < bombs.size(); k++){
+    int slot = (next + k) % bombs.size();
+    Bomb *bomb = bombs[slot];
+    if(bomb->getDynamic())
+      continue;
+    bomb->setPresent(true);
+    bomb->setPosition(cx, cy);
+    bomb->setSpeed(ux, uy);
+    bomb->setTime(0.0f);
+    bomb->setDynamic(true);
+    next = (slot + 1) % bombs.size();
+    return bomb;
+  }
+  return NULL;
+}
+
+int BombPool::getCapacity(){
+  return bombs.size();
+}
+
+int BombPool::getInFlight(){
+  int count = 0;
+  for(int k = 0; k < bombs.size(); k++)
+    if(bombs[k]->getDynamic())
+      count++;
+  return count;
+}
+
+Bomb* BombPool::getBomb(int k){
+  return bombs[k];
+}
+
+// Where fire() starts looking, part of the state a save keeps
+int BombPool::getNext(){
+  return next;
+}
+
+void BombPool::setNext(int next){
+  this->next = next;
+}
@@ -0,0 +1,271 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "bodies.h"
+#include "grid.h"
+#include "blocktree.h"
+
+/**********************************************
+ * Headless physics for cannon shot           *
+ * Nothing in here may depend on GL or GLFW,  *
+ * so batch tools can run the world directly. *
+ **********************************************/
+
+struct Bounds {
+  float left;
+  float right;
+  float top;
+  float bottom;
+};
+typedef struct Bounds Bounds;
+
+class Block;
+class World;
+
+/* Handle on one body in a BodyStore, the state itself lives there */
+class Item{
+public:
+  Item(BodyStore *bodies, Bounds *bounds, float mass, float x, float y, float ux, float uy, float radius);
+  virtual ~Item();
+  bool checkCollisionGround();
+  bool checkStoppage();
+  void setSpeed(float ux, float uy);
+  void setPosition(float x, float y);
+  void setTime(float time);
+  float getPositionX();
+  float getPositionY();
+  float getPrevPositionX();
+  float getPrevPositionY();
+  float getSpeedX();
+  float getSpeedY();
+  float getRadius();
+  float getMass();
+  bool getCollisionFlag();
+  bool isAsleep();
+  void setPresent(bool value);
+  bool isPresent();
+  int getId();
+  friend bool checkCollisionItem(Item &first, Item &second, bool& flag);
+  friend void simulateCollisionItem(Item &first, Item &second);
+
+  friend bool checkCollisionBlock(Item& ball, Block& obs);
+  friend void simulateCollisionBlock(Item& ball, Block &obs);
+
+  friend bool sweepCircleBlock(float x0, float y0, float x1, float y1, float radius, Block &obs, float &toi);
+
+  friend bool checkCollisionWall(Item& ball);
+  friend void simulateCollisionWall(Item& ball);
+  friend class World;
+  static const float GRAVITY;
+  static const float BOUNCE_COF;
+  static const float FRICTION_COF;
+  static const float OBS_BOUNCE_COF;
+  static const float WALL_BOUNCE_COF;
+protected:
+  BodyStore *bodies;
+  Bounds *bounds;
+  int id;
+  bool collisionFlag;
+};
+
+class Bomb : public Item{
+public:
+  Bomb(BodyStore *bodies, Bounds *bounds, float cx, float cy, float speedX, float speedY);
+  bool getDynamic();
+  void checkFlight();
+  void setDynamic(bool value);
+  friend class World;
+private:
+  bool dynamic;
+};
+
+/* The part of a Block that changes as it moves */
+struct BlockState {
+  float x;
+  float y;
+  float prevX;
+  float speed;
+  float time;
+};
+typedef struct BlockState BlockState;
+
+class Block
+{
+public:
+  Block(float x, float y, float width, float height, bool dynamic = false);
+  float getPositionY();
+  float getPositionX();
+  float getPrevPositionX();
+  float getHeight();
+  float getWidth();
+  float getMinX();
+  float getMaxX();
+  float getMinY();
+  float getMaxY();
+  void applyForces(float timeInstance);
+  bool isDynamic();
+  float getSpeed();
+  float getLeftBound();
+  float getRightBound();
+  BlockState getState();
+  void setState(const BlockState &state);
+  friend bool checkCollisionBlock(Item& ball, Block& obs);
+  friend void simulateCollisionBlock(Item& ball, Block &obs);
+  friend bool sweepCircleBlock(float x0, float y0, float x1, float y1, float radius, Block &obs, float &toi);
+private:
+  float x;
+  float y;
+  float prevX;
+  float width;
+  float height;
+  float halfWidth;
+  float halfHeight;
+  float leftBound;
+  float rightBound;
+  float speed;
+  float time;
+  bool dynamic;
+};
+
+class Target:public Item
+{
+public:
+  Target(BodyStore *bodies, Bounds *bounds, Block* pillar);
+  void updateSupport();
+  void followPillar();
+  bool isInContact();
+  Block* getPillar();
+private:
+  Block *pillar;
+};
+
+/* Owns every body of a level and advances them together */
+class World{
+public:
+  World(float left, float right, float top, float bottom);
+  ~World();
+  Block* addBlock(float x, float y, float width, float height, bool dynamic = false);
+  Target* addTarget(Block* pillar);
+  Bomb* addBomb(float cx, float cy, float ux, float uy);
+  void reserve(int blockCount, int bodyCount);
+  void step(float timeInstance);
+  void setIntegrator(Integrator kind);
+  Integrator getIntegrator();
+  void setContinuousCollision(bool value);
+  bool getContinuousCollision();
+  void setSleeping(bool value);
+  void setSleepTicks(int ticks);
+  int getSleepingCount();
+  BodyStore* getBodies();
+  SpatialGrid* getGrid();
+  void setBounds(float left, float right, float top, float bottom);
+  Bounds* getBounds();
+  int getScore();
+  int getTargetCount();
+  bool isCleared();
+  std::vector<Item*>& getMovableList();
+  std::vector<Block*>& getObstacleList();
+  std::vector<Target*>& getTargetList();
+  uint64_t stateHash();
+  size_t getStateSize();
+  void saveState(void *out);
+  bool loadState(const void *in);
+private:
+  void handleCollisionsItem();
+  void recheckPushedBody(int id, unsigned long long current, float escapeDistance);
+  void handleCollisionsBlock();
+  void handleCollisionsWall();
+  void rebuildBlockTrees();
+  void updateBlockTrees();
+  void sweepFastBombs();
+  bool touchesMovingBlock(int id);
+  void wakeBody(int id);
+  void updateSleep();
+  Bounds bounds;
+  BodyStore bodies;
+  Integrator integrator;
+  SpatialGrid grid;
+  BlockTree staticTree;
+  BlockTree dynamicTree;
+  bool blockTreesDirty;
+  bool continuousCollision;
+  bool sleeping;
+  int sleepTicks;
+  std::vector<int> blockHits;
+  std::vector<int> bodyHits;
+  std::vector<float> anchorX;         // where the grid last saw each body
+  std::vector<float> anchorY;
+  std::vector<int> escaped;           // bodies pushed past the padding
+  std::vector<unsigned long long> extraPairs;  // min heap of pair keys
+  std::vector<Item*> movableList;
+  std::vector<Block*> obstacleList;
+  std::vector<Bomb*> bombList;
+  std::vector<Target*> targetList;
+  int score;
+  int targetCount;
+};
+
+/* Fixed set of bombs made up front and registered with the World
+ * once. Firing only recycles them, so it never allocates. Bombs wait
+ * parked outside the simulation until they are first fired, and a
+ * landed bomb stays where it is until it is fired again. */
+class BombPool{
+public:
+  BombPool(World *world, int capacity, float cx, float cy);
+  Bomb* fire(float cx, float cy, float ux, float uy);
+  int getCapacity();
+  int getInFlight();
+  Bomb* getBomb(int k);
+  int getNext();
+  void setNext(int next);
+private:
+  std::vector<Bomb*> bombs;
+  int next;
+};
+
+/* Fixed part of a saved World. The BodyStore arrays follow it one after
+ * another, then a BlockState per block, then a byte per body for its
+ * collision flag and a byte per bomb for its flight. */
+struct WorldStateHeader {
+  uint32_t bodyCount;
+  uint32_t blockCount;
+  uint32_t bombCount;
+  int32_t score;
+  Bounds bounds;
+};
+typedef struct WorldStateHeader WorldStateHeader;
+
+/* Room for slots saved states of slotSize bytes each, allocated once so
+ * saving and restoring never allocate */
+class StateArena{
+public:
+  StateArena(size_t slotSize, int slots);
+  ~StateArena();
+  void* getSlot(int k);
+  size_t getSlotSize();
+  int getSlotCount();
+private:
+  unsigned char *memory;
+  size_t slotSize;
+  int slots;
+};
+
+/* FNV-1a over size bytes, carrying on from hash. Chains start at
+ * HASH_SEED. */
+#define HASH_SEED 1469598103934665603ULL
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size);
+
+bool checkCollisionItem(Item &first, Item &second, bool &flag);
+void simulateCollisionItem(Item &first, Item &second);
+bool checkCollisionBlock(Item& ball, Block& obs);
+void simulateCollisionBlock(Item& ball, Block &obs);
+bool checkCollisionWall(Item& ball);
+void simulateCollisionWall(Item& ball);
+bool sweepCircleBlock(float x0, float y0, float x1, float y1, float radius, Block &obs, float &toi);
+bool sweepCircleCircle(float ax0, float ay0, float ax1, float ay1, float bx0, float by0, float bx1, float by1, float reach, float &toi);
+
+#endif
@@ -0,0 +1,158 @@
+#include "profiler.h"
+
+#ifdef PROFILE
+
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct ProfileEvent {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+};
+
+/* A ring slot. Its fields are atomics so the exporter can read a slot
+ * its thread is rewriting; relaxed loads and stores cost the same as
+ * plain ones. */
+struct ProfileSlot {
+  atomic<const char*> name;
+  atomic<uint64_t> start;
+  atomic<uint64_t> end;
+};
+
+/* Only its own thread writes a ring. written counts every event ever
+ * recorded and works as a seqlock: it is published after an event, and
+ * slot written % PROFILE_RING_SIZE is the one being filled next. */
+struct ProfileRing {
+  int id;
+  string name;
+  atomic<uint64_t> written;
+  ProfileSlot events[PROFILE_RING_SIZE];
+};
+
+// Taken only when a thread records its first event, to export, or to
+// rename a thread
+static mutex registryLock;
+static vector<ProfileRing*> rings;
+static thread_local ProfileRing *threadRing = NULL;
+
+static ProfileRing* currentRing(){
+  if(threadRing == NULL){
+    ProfileRing *ring = new ProfileRing();
+    ring->written.store(0);
+    lock_guard<mutex> guard(registryLock);
+    ring->id = rings.size() + 1;
+    char name[32];
+    snprintf(name, sizeof(name), "thread %d", ring->id);
+    ring->name = name;
+    rings.push_back(ring);
+    threadRing = ring;
+  }
+  return threadRing;
+}
+
+uint64_t profileNow(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void profileRecord(const char *name, uint64_t start, uint64_t end){
+  ProfileRing *ring = currentRing();
+  uint64_t n = ring->written.load(memory_order_relaxed);
+  ProfileSlot &slot = ring->events[n % PROFILE_RING_SIZE];
+  // a reader that sees any of the stores below also sees written == n
+  atomic_thread_fence(memory_order_release);
+  slot.name.store(name, memory_order_relaxed);
+  slot.start.store(start, memory_order_relaxed);
+  slot.end.store(end, memory_order_relaxed);
+  ring->written.store(n + 1, memory_order_release);
+}
+
+void profileThreadName(const char *name){
+  ProfileRing *ring = currentRing();
+  lock_guard<mutex> guard(registryLock);
+  ring->name = name;
+}
+
+static void writeString(FILE *file, const char *text){
+  fputc('"', file);
+  for(const char *c = text; *c != '\0'; c++){
+    if(*c == '"' || *c == '\\')
+      fputc('\\', file);
+    if((unsigned char)*c >= 32)
+      fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+/* Safe while other threads keep recording. A ring is copied out and
+ * any slot its thread may have overwritten during the copy, or was in
+ * the middle of writing, is dropped. */
+bool profileExport(const char *path){
+  vector<ProfileRing*> snapshot;
+  vector<string> names;
+  {
+    lock_guard<mutex> guard(registryLock);
+    snapshot = rings;
+    for(int i = 0; i < rings.size(); i++)
+      names.push_back(rings[i]->name);
+  }
+
+  vector<vector<ProfileEvent> > copies(snapshot.size());
+  uint64_t origin = UINT64_MAX;
+  for(int i = 0; i < snapshot.size(); i++){
+    ProfileRing *ring = snapshot[i];
+    uint64_t end = ring->written.load(memory_order_acquire);
+    uint64_t begin = end > PROFILE_RING_SIZE ? end - PROFILE_RING_SIZE : 0;
+    vector<ProfileEvent> events;
+    for(uint64_t n = begin; n < end; n++){
+      ProfileSlot &slot = ring->events[n % PROFILE_RING_SIZE];
+      ProfileEvent event;
+      event.name = slot.name.load(memory_order_relaxed);
+      event.start = slot.start.load(memory_order_relaxed);
+      event.end = slot.end.load(memory_order_relaxed);
+      events.push_back(event);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    // slot after % PROFILE_RING_SIZE may be half written, it goes too
+    uint64_t after = ring->written.load(memory_order_relaxed);
+    uint64_t firstIntact = after + 1 > PROFILE_RING_SIZE ? after + 1 - PROFILE_RING_SIZE : 0;
+    if(firstIntact > begin)
+      events.erase(events.begin(), events.begin() + min(firstIntact - begin, (uint64_t)events.size()));
+    for(int k = 0; k < events.size(); k++)
+      origin = min(origin, events[k].start);
+    copies[i].swap(events);
+  }
+
+  FILE *file = fopen(path, "w");
+  if(file == NULL)
+    return false;
+  fprintf(file, "{\"traceEvents\":[\n");
+  bool first = true;
+  for(int i = 0; i < snapshot.size(); i++){
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+            first ? "" : ",\n", snapshot[i]->id);
+    writeString(file, names[i].c_str());
+    fprintf(file, "}}");
+    first = false;
+    for(int k = 0; k < copies[i].size(); k++){
+      const ProfileEvent &event = copies[i][k];
+      fprintf(file, ",\n{\"name\":");
+      writeString(file, event.name);
+      fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              snapshot[i]->id, (event.start - origin) / 1000.0, (event.end - event.start) / 1000.0);
+    }
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* Scoped zone profiler, built only with -DPROFILE (make
+ * PROFILE_FLAGS=-DPROFILE). Without it every macro below is empty and
+ * profileExport() does nothing, so zones can stay in hot code.
+ *
+ *   PROFILE_ZONE("name");    times the rest of the enclosing block
+ *   PROFILE_THREAD("name");  labels the calling thread in the trace
+ *
+ * Names must be string literals, only the pointer is kept. Each
+ * thread records into a ring buffer of its own with no locks, the
+ * oldest events are overwritten once it is full. profileExport()
+ * writes what the rings hold as Chrome trace event JSON, for
+ * chrome://tracing or ui.perfetto.dev. */
+
+#ifdef PROFILE
+
+#include <stdint.h>
+
+#define PROFILE_RING_SIZE (1 << 17)  // events kept per thread
+
+uint64_t profileNow();
+void profileRecord(const char *name, uint64_t start, uint64_t end);
+void profileThreadName(const char *name);
+bool profileExport(const char *path);
+
+class ProfileZone{
+public:
+  ProfileZone(const char *name){
+    this->name = name;
+    this->start = profileNow();
+  }
+  ~ProfileZone(){
+    profileRecord(name, start, profileNow());
+  }
+private:
+  const char *name;
+  uint64_t start;
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_JOIN(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) profileThreadName(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+static inline bool profileExport(const char *path){
+  return false;
+}
+
+#endif
+
+#endif
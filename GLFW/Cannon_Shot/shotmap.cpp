@@ -0,0 +1,386 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <algorithm>
+
+#include "physics.h"
+#include "level.h"
+#include "workpool.h"
+#include "profiler.h"
+
+using namespace std;
+
+/* Shot space explorer. Fires a grid of barrel angles (0 to -90, what
+ * Cannon::setBarrelAngle() allows) and bomb speeds at a level on every
+ * core, and reports which shots hit each target, then searches for the
+ * fewest shots that clear the level.
+ *
+ * Shots are simulated the way the game plays them: the same World
+ * built in the same order, fixed PHYSICS_STEP steps and the bomb
+ * placed and launched as Cannon::shoot() does, so a shot found here
+ * does the same in the game. A shot is fired from the level as it is
+ * when loaded, or, while searching, as soon as the shot before it has
+ * settled. Moving blocks make a later shot differ. */
+
+const float PHYSICS_STEP = 0.01f;  // the game's
+const float BARREL_LENGTH = 16.0f; // Cannon's barrel rectangle height
+const int MAX_TARGETS = 64;        // hit sets are 64 bit masks
+
+struct ShotResult {
+  uint64_t hits;   // every target hit so far, before this shot too
+  bool cleared;    // the game would have declared a win
+  int ticks;       // steps until it settled
+};
+typedef struct ShotResult ShotResult;
+
+/* A world of its own to shoot in, one per thread */
+class ShotRunner{
+public:
+  ShotRunner(Level &level, int maxTicks, int settleTicks);
+  ~ShotRunner();
+  void shoot(const void *state, float angle, float speed, ShotResult &result);
+  size_t getStateSize();
+  void saveState(void *out);
+private:
+  World *world;
+  BombPool *pool;
+  float tankX;
+  float tankY;
+  int maxTicks;
+  int settleTicks;
+};
+
+/* Built the way initSimulation() in the game builds it, bomb pool
+ * before the level, so body ids are the game's */
+ShotRunner::ShotRunner(Level &level, int maxTicks, int settleTicks){
+  this->maxTicks = maxTicks;
+  this->settleTicks = settleTicks;
+  tankX = (int)level.getCannonX();
+  tankY = (int)level.getCannonY();
+  world = new World(level.getLeft(), level.getRight(), level.getTop(), level.getBottom());
+  pool = new BombPool(world, 1, tankX, tankY);
+  level.build(world);
+}
+
+ShotRunner::~ShotRunner(){
+  delete pool;
+  delete world;
+}
+
+size_t ShotRunner::getStateSize(){
+  return world->getStateSize();
+}
+
+void ShotRunner::saveState(void *out){
+  world->saveState(out);
+}
+
+/* Fires from state and steps until the bomb stops or leaves, then up to
+ * settleTicks more while any target is still moving, or until the level
+ * is cleared. The world is left as the shot left it. */
+void ShotRunner::shoot(const void *state, float angle, float speed, ShotResult &result){
+  world->loadState(state);
+  pool->setNext(0);
+  result.cleared = false;
+  result.ticks = 0;
+  // Cannon::shoot(), expression for expression
+  float radAngle = (angle + 90.0f) * M_PI/180.0f;
+  float cx = tankX + (BARREL_LENGTH/2)*cosf(radAngle);
+  float cy = tankY + (BARREL_LENGTH/2)*sinf(radAngle);
+  Bomb *bomb = pool->fire(cx, cy, speed*cosf(radAngle), speed*sinf(radAngle));
+  std::vector<Target*> &targets = world->getTargetList();
+  if(bomb != NULL){
+    int settling = -1;
+    for(int tick = 0; tick < maxTicks && settling != 0 && !result.cleared; tick++){
+      world->step(PHYSICS_STEP);
+      result.ticks++;
+      if(world->isCleared())
+        result.cleared = true;
+      if(settling < 0 && !bomb->getDynamic())
+        settling = settleTicks;
+      else if(settling > 0){
+        settling--;
+        bool moving = false;
+        for(int k = 0; k < targets.size() && !moving; k++)
+          moving = !targets[k]->isAsleep();
+        if(!moving)
+          settling = 0;
+      }
+    }
+  }
+  result.hits = 0;
+  for(int k = 0; k < targets.size(); k++)
+    if(targets[k]->getCollisionFlag())
+      result.hits |= 1ULL << k;
+}
+
+static int countBits(uint64_t bits){
+  int count = 0;
+  for(; bits != 0; bits &= bits - 1)
+    count++;
+  return count;
+}
+
+static double secondsSince(const struct timespec &from){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - from.tv_sec) + (now.tv_nsec - from.tv_nsec) / 1000000000.0;
+}
+
+/* The angle x speed grid, shot i is angle i % angles, speed i / angles */
+struct ShotGrid {
+  int angles;
+  int speeds;
+  float speedMin;
+  float speedMax;
+
+  int size(){
+    return angles * speeds;
+  }
+  float angle(int i){
+    return angles > 1 ? -90.0f * (i % angles) / (angles - 1) : 0.0f;
+  }
+  float speed(int i){
+    return speeds > 1 ? speedMin + (speedMax - speedMin) * (i / angles) / (speeds - 1) : speedMin;
+  }
+};
+typedef struct ShotGrid ShotGrid;
+
+/* Every shot of the grid from state, spread over the pool */
+static void sweep(WorkPool &pool, std::vector<ShotRunner*> &runners, ShotGrid &grid,
+                  const void *state, std::vector<ShotResult> &results){
+  PROFILE_ZONE("sweep");
+  results.resize(grid.size());
+  pool.run(grid.size(), 64, [&](int i, int worker){
+    runners[worker]->shoot(state, grid.angle(i), grid.speed(i), results[i]);
+  });
+}
+
+/* One PGM per target, a column per angle from 0 on the left to -90,
+ * a row per speed with the fastest at the top, white where it is hit */
+static bool writeHitMaps(const char *prefix, ShotGrid &grid, std::vector<ShotResult> &results, int targets){
+  std::vector<unsigned char> row(grid.angles);
+  for(int k = 0; k < targets; k++){
+    char path[512];
+    snprintf(path, sizeof(path), "%s%d.pgm", prefix, k);
+    FILE *file = fopen(path, "wb");
+    if(file == NULL){
+      fprintf(stderr, "%s: could not write hit map\n", path);
+      return false;
+    }
+    fprintf(file, "P5\n%d %d\n255\n", grid.angles, grid.speeds);
+    for(int s = grid.speeds - 1; s >= 0; s--){
+      for(int a = 0; a < grid.angles; a++)
+        row[a] = (results[s * grid.angles + a].hits >> k) & 1 ? 255 : 0;
+      fwrite(&row[0], 1, row.size(), file);
+    }
+    if(fclose(file) != 0){
+      fprintf(stderr, "%s: could not write hit map\n", path);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* A state reached by some shots, in the search */
+struct SearchNode {
+  uint64_t hits;
+  std::vector<int> shots;
+  std::vector<int> ticks;  // tick each shot is fired on
+  int tick;                // tick the last one settled on
+};
+typedef struct SearchNode SearchNode;
+
+static void usage(){
+  fprintf(stderr, "usage: shotmap [options] <level>\n"
+                  "  --angles N           barrel angles from 0 to -90 (default 451)\n"
+                  "  --speeds MIN MAX N   bomb speeds (default 20 200 181)\n"
+                  "  --threads N          worker threads (default every core)\n"
+                  "  --shots N            most shots a solution may take (default 10)\n"
+                  "  --beam N             states kept per shot while searching (default 16)\n"
+                  "  --max-ticks N        longest a shot is followed (default 3000)\n"
+                  "  --maps PREFIX        write the hit map of target k to PREFIXk.pgm\n");
+}
+
+int main(int argc, char **argv){
+  ShotGrid grid;
+  grid.angles = 451;
+  grid.speeds = 181;
+  grid.speedMin = 20.0f;
+  grid.speedMax = 200.0f;
+  int threads = std::thread::hardware_concurrency();
+  int maxShots = 10;
+  int beam = 16;
+  int maxTicks = 3000;
+  const char *maps = NULL;
+  const char *levelPath = NULL;
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "--angles") == 0 && i + 1 < argc)
+      grid.angles = max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--speeds") == 0 && i + 3 < argc){
+      grid.speedMin = atof(argv[++i]);
+      grid.speedMax = atof(argv[++i]);
+      grid.speeds = max(1, atoi(argv[++i]));
+    }
+    else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      threads = max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--shots") == 0 && i + 1 < argc)
+      maxShots = max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--beam") == 0 && i + 1 < argc)
+      beam = max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc)
+      maxTicks = max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--maps") == 0 && i + 1 < argc)
+      maps = argv[++i];
+    else if(argv[i][0] != '-' && levelPath == NULL)
+      levelPath = argv[i];
+    else{
+      usage();
+      return 1;
+    }
+  }
+  if(levelPath == NULL){
+    usage();
+    return 1;
+  }
+  Level level;
+  if(!level.load(levelPath)){
+    fprintf(stderr, "%s\n", level.getError());
+    return 1;
+  }
+  if(level.getTargetCount() > MAX_TARGETS){
+    fprintf(stderr, "%s: more than %d targets\n", levelPath, MAX_TARGETS);
+    return 1;
+  }
+  if(level.getTargetCount() == 0){
+    fprintf(stderr, "%s: no targets\n", levelPath);
+    return 1;
+  }
+
+  PROFILE_THREAD("main");
+  const int settleTicks = 100;
+  WorkPool pool(threads);
+  std::vector<ShotRunner*> runners;
+  for(int w = 0; w < pool.getThreadCount(); w++)
+    runners.push_back(new ShotRunner(level, maxTicks, settleTicks));
+  // Replays the chosen shots on this thread to get the states they leave
+  ShotRunner chooser(level, maxTicks, settleTicks);
+
+  int targets = level.getTargetCount();
+  printf("%s: %d targets, %d angles x %d speeds (%.1f to %.1f) = %d shots a sweep, %d threads\n",
+         levelPath, targets, grid.angles, grid.speeds, grid.speedMin, grid.speedMax,
+         grid.size(), pool.getThreadCount());
+
+  // Two arenas of beam states, the shots being searched from and the
+  // states they lead to
+  StateArena *current = new StateArena(chooser.getStateSize(), beam);
+  StateArena *next = new StateArena(chooser.getStateSize(), beam);
+  chooser.saveState(current->getSlot(0));
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  long shotsFired = 0;
+  int sweeps = 0;
+  std::vector<ShotResult> results;
+  sweep(pool, runners, grid, current->getSlot(0), results);
+  shotsFired += grid.size();
+  sweeps++;
+
+  for(int k = 0; k < targets; k++){
+    int count = 0;
+    for(int i = 0; i < results.size(); i++)
+      if((results[i].hits >> k) & 1)
+        count++;
+    printf("target %d: hit by %d shots (%.2f%%)\n", k, count, 100.0 * count / grid.size());
+  }
+  if(maps != NULL && !writeHitMaps(maps, grid, results, targets))
+    return 1;
+
+  /* Breadth first over how many shots have been fired. Shots that leave
+   * the same set of targets hit count as one, the first in grid order,
+   * and so do sets already reached with fewer shots. Only the beam sets
+   * with the most targets are followed, so the answer is the fewest
+   * shots among those kept. */
+  std::vector<SearchNode> nodes(1);
+  nodes[0].hits = 0;
+  nodes[0].tick = 0;
+  std::map<uint64_t, bool> seen;
+  seen[0] = true;
+  std::vector<int> solution;
+  std::vector<int> solutionTicks;
+  for(int depth = 1; depth <= maxShots && solution.empty() && !nodes.empty(); depth++){
+    std::map<uint64_t, std::pair<int, int> > reached;  // hit set -> node, shot
+    for(int n = 0; n < nodes.size() && solution.empty(); n++){
+      if(depth > 1){
+        sweep(pool, runners, grid, current->getSlot(n), results);
+        shotsFired += grid.size();
+        sweeps++;
+      }
+      for(int i = 0; i < results.size(); i++){
+        if(results[i].cleared){
+          solution = nodes[n].shots;
+          solution.push_back(i);
+          solutionTicks = nodes[n].ticks;
+          solutionTicks.push_back(nodes[n].tick);
+          break;
+        }
+        if(seen.count(results[i].hits) == 0 && reached.count(results[i].hits) == 0)
+          reached[results[i].hits] = std::make_pair(n, i);
+      }
+    }
+    if(!solution.empty())
+      break;
+
+    std::vector<std::pair<int, uint64_t> > order;  // most targets first
+    for(std::map<uint64_t, std::pair<int, int> >::iterator it = reached.begin(); it != reached.end(); ++it)
+      order.push_back(std::make_pair(-countBits(it->first), it->first));
+    sort(order.begin(), order.end());
+    std::vector<SearchNode> following;
+    for(int k = 0; k < order.size() && k < beam; k++){
+      seen[order[k].second] = true;
+      std::pair<int, int> from = reached[order[k].second];
+      ShotResult result;
+      chooser.shoot(current->getSlot(from.first), grid.angle(from.second), grid.speed(from.second), result);
+      chooser.saveState(next->getSlot(following.size()));
+      SearchNode node;
+      node.hits = result.hits;
+      node.shots = nodes[from.first].shots;
+      node.shots.push_back(from.second);
+      node.ticks = nodes[from.first].ticks;
+      node.ticks.push_back(nodes[from.first].tick);
+      node.tick = nodes[from.first].tick + result.ticks;
+      following.push_back(node);
+    }
+    printf("%d shot%s: %d hit sets reached, best %d of %d targets\n", depth, depth == 1 ? "" : "s",
+           (int)reached.size(), order.empty() ? 0 : -order[0].first, targets);
+    nodes.swap(following);
+    std::swap(current, next);
+  }
+
+  double seconds = secondsSince(start);
+  printf("%d sweeps, %ld shots in %.2f s, %.0f shots/s, %ld chunks stolen\n",
+         sweeps, shotsFired, seconds, shotsFired / seconds, pool.getSteals());
+  if(solution.empty() && nodes.empty())
+    printf("no way to clear the level was found, no shot hits anything new\n");
+  else if(solution.empty())
+    printf("no way to clear the level in %d shots was found\n", maxShots);
+  else{
+    printf("cleared in %d shot%s:\n", (int)solution.size(), solution.size() == 1 ? "" : "s");
+    for(int k = 0; k < solution.size(); k++)
+      printf("  %d: angle %.2f speed %.2f, fired on tick %d\n", k + 1, grid.angle(solution[k]),
+             grid.speed(solution[k]), solutionTicks[k]);
+  }
+
+  for(int w = 0; w < runners.size(); w++)
+    delete runners[w];
+  delete current;
+  delete next;
+  profileExport("shotmap.json");
+  return solution.empty() ? 2 : 0;
+}
@@ -0,0 +1,51 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+
+/* A fixed size ring for exactly one producer thread and one consumer
+ * thread, with no locks. push() fails instead of waiting when the ring
+ * is full. The two counters only ever grow, they wrap with unsigned
+ * arithmetic and a slot is the counter masked by CAPACITY - 1, which
+ * has to be a power of two. Each counter sits on a cache line of its
+ * own so the two threads do not keep stealing it from each other. */
+template<class T, unsigned CAPACITY>
+class SpscQueue{
+public:
+  SpscQueue(){
+    head.store(0);
+    tail.store(0);
+  }
+
+  // Producer only
+  bool push(const T &value){
+    unsigned t = tail.load(std::memory_order_relaxed);
+    if(t - head.load(std::memory_order_acquire) == CAPACITY)
+      return false;
+    slots[t & (CAPACITY - 1)] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. The oldest value without taking it, NULL when empty.
+  T* front(){
+    unsigned h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire))
+      return NULL;
+    return &slots[h & (CAPACITY - 1)];
+  }
+
+  // Consumer only, after front() gave a value
+  void pop(){
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+private:
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SpscQueue capacity must be a power of two");
+  alignas(64) std::atomic<unsigned> head;  // next slot to read
+  alignas(64) std::atomic<unsigned> tail;  // next slot to write
+  T slots[CAPACITY];
+};
+
+#endif
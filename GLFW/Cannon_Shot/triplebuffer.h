@@ -0,0 +1,51 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+/* Hands the newest value from one writer thread to one reader thread
+ * with no locks and no waiting on either side. There are three slots:
+ * the writer fills its back slot, the reader looks at its front slot,
+ * and the third sits in the middle holding the last one published.
+ * Publishing and reading each swap a slot with the middle, so the
+ * writer never touches what the reader has and the reader always gets
+ * the latest complete value, skipping any it was too slow to see.
+ *
+ * The slots are reused, so a T that owns memory (vectors) stops
+ * allocating once each slot has grown to size. */
+template<class T>
+class TripleBuffer{
+public:
+  TripleBuffer(){
+    back = 0;
+    middle.store(1);
+    front = 2;
+  }
+
+  // The slot to fill before the next publish(). It still holds
+  // whatever was written to it three publishes ago.
+  T& write(){
+    return slots[back];
+  }
+
+  void publish(){
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // The newest published value. It stays the same, and valid, until
+  // the next call of read() on this thread.
+  T& read(){
+    if(middle.load(std::memory_order_relaxed) & FRESH)
+      front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+    return slots[front];
+  }
+
+private:
+  enum { INDEX = 3, FRESH = 4 };  // a slot index, and whether the reader has had it
+  T slots[3];
+  int back;                       // only the writer uses this
+  std::atomic<int> middle;
+  int front;                      // only the reader uses this
+};
+
+#endif
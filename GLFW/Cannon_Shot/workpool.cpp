@@ -0,0 +1,116 @@
+#include <algorithm>
+
+#include "workpool.h"
+#include "profiler.h"
+
+using namespace std;
+
+WorkPool::WorkPool(int threads){
+  threads = max(1, threads);
+  this->job = NULL;
+  this->generation = 0;
+  this->busy = 0;
+  this->steals.store(0);
+  this->quitting = false;
+  for(int w = 0; w < threads; w++)
+    queues.push_back(new Queue());
+  for(int w = 0; w < threads; w++)
+    this->threads.push_back(thread(&WorkPool::work, this, w));
+}
+
+WorkPool::~WorkPool(){
+  {
+    lock_guard<mutex> guard(lock);
+    quitting = true;
+  }
+  started.notify_all();
+  for(int w = 0; w < threads.size(); w++)
+    threads[w].join();
+  for(int w = 0; w < queues.size(); w++)
+    delete queues[w];
+}
+
+int WorkPool::getThreadCount(){
+  return threads.size();
+}
+
+// Chunks taken from another worker's deque, over every run so far
+long WorkPool::getSteals(){
+  return steals.load();
+}
+
+void WorkPool::run(int count, int chunk, const function<void(int, int)> &job){
+  if(count <= 0)
+    return;
+  chunk = max(1, chunk);
+  int workers = queues.size();
+  int chunks = (count + chunk - 1) / chunk;
+  // worker w gets chunks [w * chunks / workers, (w + 1) * chunks / workers)
+  for(int w = 0; w < workers; w++){
+    lock_guard<mutex> guard(queues[w]->lock);
+    for(int c = w * chunks / workers; c < (w + 1) * chunks / workers; c++){
+      Chunk range;
+      range.begin = c * chunk;
+      range.end = min(count, range.begin + chunk);
+      queues[w]->chunks.push_back(range);
+    }
+  }
+  unique_lock<mutex> guard(lock);
+  this->job = &job;
+  busy = workers;
+  generation++;
+  started.notify_all();
+  finished.wait(guard, [this]{ return busy == 0; });
+  this->job = NULL;
+}
+
+/* Own chunks first, then anyone else's, nearest worker first. Nothing
+ * is added during a run, so when every deque is empty the run is over
+ * for this worker. */
+bool WorkPool::take(int worker, Chunk &chunk){
+  {
+    Queue &own = *queues[worker];
+    lock_guard<mutex> guard(own.lock);
+    if(!own.chunks.empty()){
+      chunk = own.chunks.front();
+      own.chunks.pop_front();
+      return true;
+    }
+  }
+  for(int k = 1; k < queues.size(); k++){
+    Queue &victim = *queues[(worker + k) % queues.size()];
+    lock_guard<mutex> guard(victim.lock);
+    if(!victim.chunks.empty()){
+      chunk = victim.chunks.back();
+      victim.chunks.pop_back();
+      steals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkPool::work(int worker){
+  PROFILE_THREAD("work pool");
+  long seen = 0;
+  while(true){
+    const function<void(int, int)> *job;
+    {
+      unique_lock<mutex> guard(lock);
+      started.wait(guard, [this, seen]{ return quitting || generation != seen; });
+      if(quitting)
+        return;
+      seen = generation;
+      job = this->job;
+    }
+    Chunk chunk;
+    while(take(worker, chunk)){
+      PROFILE_ZONE("work pool chunk");
+      for(int i = chunk.begin; i < chunk.end; i++)
+        (*job)(i, worker);
+    }
+    lock_guard<mutex> guard(lock);
+    if(--busy == 0)
+      finished.notify_all();
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/* Work stealing thread pool for batches of independent jobs.
+ * run() cuts the indices 0 .. count - 1 into chunks and deals each
+ * worker a contiguous run of them. A worker takes chunks from the front
+ * of its own deque; once that is empty it steals from the back of
+ * another's, so workers that got cheap jobs help out the ones that
+ * got the slow ones. Each deque has a lock of its own, so the only
+ * contention is between a worker and a thief on the same deque. */
+class WorkPool{
+public:
+  WorkPool(int threads);
+  ~WorkPool();
+  // Calls job(index, worker) once for every index, blocks until all
+  // are done. worker is 0 .. getThreadCount() - 1, for per thread state.
+  void run(int count, int chunk, const std::function<void(int, int)> &job);
+  int getThreadCount();
+  long getSteals();
+private:
+  struct Chunk {
+    int begin;
+    int end;
+  };
+  struct Queue {
+    std::mutex lock;
+    std::deque<Chunk> chunks;
+  };
+  void work(int worker);
+  bool take(int worker, Chunk &chunk);
+  std::vector<std::thread> threads;
+  std::vector<Queue*> queues;
+  std::mutex lock;                    // guards job, generation, busy and quitting
+  std::condition_variable started;
+  std::condition_variable finished;
+  const std::function<void(int, int)> *job;
+  long generation;                    // bumped by every run()
+  int busy;                           // workers still in this run
+  bool quitting;
+  std::atomic<long> steals;
+};
+
+#endif